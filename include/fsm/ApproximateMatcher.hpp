@@ -0,0 +1,140 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <vector>
+#include "fsm/FollowTable.hpp"
+
+namespace fsm {
+
+class Fsm;
+
+/// Matches the pattern of an FSM with up to a given number of errors, an
+/// error being the insertion, deletion or substitution of one byte.
+///
+/// The FSM is turned into a position automaton, in which all edges into a
+/// state read the same bytes. After every input byte, row i of the matcher
+/// holds the positions reachable with at most i errors, and the rows are
+/// advanced with the recurrence of Wu and Manber. Up to MaxShortPositions
+/// positions a row is one machine word and the recurrence is evaluated
+/// directly. Larger patterns are matched with a DFA over the rows, the
+/// Levenshtein product automaton, built lazily into a Cache.
+class ApproximateMatcher final
+{
+public: // types
+    using mask_t = std::uint64_t;
+
+    static const std::size_t MaxShortPositions = 64;
+
+    /// Product states discovered by earlier calls, which later inputs walk
+    /// without computing them again. Passing it to another matcher empties
+    /// it first. Nothing in it is synchronized.
+    class Cache final
+    {
+    public: // methods
+        Cache();
+
+    private: // types
+        friend class ApproximateMatcher;
+
+        static constexpr std::size_t Unknown = static_cast<std::size_t>(-1);
+
+        struct Automaton
+        {
+            std::map<std::vector<mask_t>, std::size_t> ids;
+            std::vector<const std::vector<mask_t> *> rows;
+            std::vector<bool> final;
+            std::vector<bool> dead;
+            std::vector<std::size_t> next;
+        };
+
+    private: // fields
+        /// Id of the matcher the automata belong to, 0 if none
+        std::uint64_t m_owner;
+        Automaton m_anchored;
+        Automaton m_unanchored;
+    };
+
+public: // methods
+    /// Builds the matcher of the pattern of an FSM, allowing the given
+    /// number of errors
+    ApproximateMatcher(const Fsm &fsm, std::size_t errors);
+
+    /// Returns true if the input is within the allowed number of errors of
+    /// some string of the pattern
+    bool match(const char *data, std::size_t size) const;
+    bool match(const char *data, std::size_t size, Cache &cache) const;
+
+    /// Returns true if some substring of the input is within the allowed
+    /// number of errors of some string of the pattern
+    bool search(const char *data, std::size_t size) const;
+    bool search(const char *data, std::size_t size, Cache &cache) const;
+
+    std::size_t getPositionCount() const;
+
+    /// Returns true if the rows fit a machine word and no cache is used
+    bool isBitParallel() const;
+
+private: // types
+    /// States of the product automaton kept before the cache is flushed
+    static const std::size_t MaxCacheStates = 4096;
+
+private: // methods
+    bool runShort(const char *data, std::size_t size, bool anchored) const;
+
+    bool runLazy(
+        const char *data,
+        std::size_t size,
+        bool anchored,
+        Cache &cache) const;
+
+    /// Returns the id of the product state with the given rows, adding it
+    /// to the automaton
+    std::size_t addState(
+        Cache::Automaton &automaton,
+        std::vector<mask_t> rows) const;
+
+    /// Computes the rows after reading byte from the given rows
+    void step(
+        const mask_t *rows,
+        unsigned char byte,
+        bool anchored,
+        std::vector<mask_t> &result) const;
+
+    /// Sets result to the positions following those of states
+    void follow(const mask_t *states, mask_t *result) const;
+
+    /// Returns the rows before any byte is read: row i also holds what is
+    /// reached from the start by deleting up to i bytes of the pattern
+    std::vector<mask_t> initialRows() const;
+
+private: // fields
+    /// Unique among the matchers built by the process, so that a cache is
+    /// never mistaken for that of a matcher since destroyed at the same
+    /// address. Copies share the id, as they share the product automaton.
+    std::uint64_t m_id;
+
+    std::size_t m_errors;
+    std::size_t m_positions;
+    std::size_t m_words;
+
+    /// Words of every set of positions, one set per byte
+    std::vector<mask_t> m_symbols;
+
+    /// Words of the follow set of every position
+    std::vector<mask_t> m_follow;
+
+    std::vector<mask_t> m_starting;
+    std::vector<mask_t> m_final;
+
+    /// Follow sets of the positions, for patterns of one word
+    FollowTable m_short_follow;
+
+    /// Bytes that read the same positions share a class
+    std::array<std::uint8_t, 256> m_classes;
+    std::size_t m_class_count;
+};
+
+} // namespace fsm
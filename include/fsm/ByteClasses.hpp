@@ -0,0 +1,61 @@
+#pragma once
+
+#include <array>
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "fsm/ByteFold.hpp"
+
+namespace fsm {
+
+class Fsm;
+
+/// Transitions of a deterministic FSM with bytes grouped into classes.
+///
+/// Bytes that lead every state to the same successor are indistinguishable,
+/// so table-driven matchers only store one successor per class. Missing
+/// transitions lead to a dead state appended after the states of the FSM.
+class ByteClasses final
+{
+public: // methods
+    /// Groups the bytes of a deterministic FSM, in which every byte takes
+    /// the transitions of the byte it folds to. Throws std::runtime_error
+    /// if the FSM has epsilon edges or conflicting edges.
+    explicit ByteClasses(const Fsm &fsm, const ByteFold &fold = identityFold());
+
+    std::uint8_t getClass(unsigned char byte) const;
+    const std::array<std::uint8_t, 256> &getClasses() const;
+    std::size_t getClassCount() const;
+
+    /// Number of states, the dead state included
+    std::size_t getStateCount() const;
+    std::size_t getDeadState() const;
+
+    /// Returns the successor of a state for the bytes of a class
+    std::size_t next(std::size_t state, std::size_t cls) const;
+
+    /// Successors of all states, one row of getClassCount() entries each
+    const std::vector<std::size_t> &getSuccessors() const;
+
+    /// Splits the classes of a partition of the bytes so that bytes only
+    /// share a class if they also do in other. Returns the class count.
+    static std::size_t refine(
+        std::array<std::uint8_t, 256> &classes,
+        const std::array<std::uint8_t, 256> &other);
+
+    /// Splits the classes of a partition of the bytes so that bytes only
+    /// share a class if the set holds both or neither of them. Returns the
+    /// class count.
+    static std::size_t refine(
+        std::array<std::uint8_t, 256> &classes,
+        const std::bitset<256> &set);
+
+private: // fields
+    std::array<std::uint8_t, 256> m_classes;
+    std::size_t m_class_count;
+    std::size_t m_dead;
+    std::vector<std::size_t> m_successors;
+};
+
+} // namespace fsm
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+
+namespace fsm {
+
+/// Map from every byte to the canonical byte it is matched as.
+///
+/// Patterns are compiled over canonical bytes only, so a folded letter costs
+/// one edge rather than one per case. Matching engines built with a fold
+/// give every byte the transitions of its canonical byte when their tables
+/// are filled, which makes folding free per input byte.
+using ByteFold = std::array<unsigned char, 256>;
+
+/// Maps every byte to itself
+inline ByteFold identityFold()
+{
+    ByteFold fold;
+
+    for (std::size_t byte = 0; byte < fold.size(); byte++)
+    {
+        fold[byte] = static_cast<unsigned char>(byte);
+    }
+
+    return fold;
+}
+
+/// Maps ASCII upper case letters to lower case
+inline ByteFold caseFold()
+{
+    ByteFold fold = identityFold();
+
+    for (int c = 'A'; c <= 'Z'; c++)
+    {
+        fold[c] = static_cast<unsigned char>(c - 'A' + 'a');
+    }
+
+    return fold;
+}
+
+} // namespace fsm
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory_resource>
+
+namespace fsm {
+
+/// Memory resource that forwards to an upstream resource and counts what
+/// goes through it.
+///
+/// Passing one to Regex::buildFsm() or an Fsm constructor measures how much
+/// a compilation allocates; stacking it on a monotonic buffer resource
+/// counts the allocations the arena absorbs.
+class CountingResource final : public std::pmr::memory_resource
+{
+public: // methods
+    explicit CountingResource(
+        std::pmr::memory_resource *upstream = std::pmr::get_default_resource());
+
+    std::size_t getAllocationCount() const;
+    std::size_t getDeallocationCount() const;
+
+    /// Total number of bytes requested, including those freed since
+    std::size_t getAllocatedBytes() const;
+
+    void reset();
+
+private: // methods
+    void *do_allocate(std::size_t bytes, std::size_t alignment) override;
+
+    void do_deallocate(
+        void *p,
+        std::size_t bytes,
+        std::size_t alignment) override;
+
+    bool do_is_equal(
+        const std::pmr::memory_resource &other) const noexcept override;
+
+private: // fields
+    std::pmr::memory_resource *m_upstream;
+    std::atomic<std::size_t> m_allocations;
+    std::atomic<std::size_t> m_deallocations;
+    std::atomic<std::size_t> m_bytes;
+};
+
+} // namespace fsm
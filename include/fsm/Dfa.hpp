@@ -0,0 +1,168 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string_view>
+#include <vector>
+#include "fsm/ByteFold.hpp"
+
+namespace fsm {
+
+class Fsm;
+
+/// Dense, immutable transition table of a deterministic automaton.
+///
+/// Input bytes are mapped to equivalence classes first, so that every state
+/// only stores one successor per class. Missing transitions lead to an
+/// explicit dead state.
+///
+/// States from which no final state is reachable are dead, and final states
+/// from which only final states are reachable are absorbing. Both decide
+/// the result whatever input follows, so the matchers stop on reaching one.
+///
+/// Table entries use the narrowest unsigned type that holds every state.
+/// When it costs no extra width, entries are premultiplied row offsets
+/// rather than state indices, which saves a multiplication per byte. States
+/// handed out by the public interface are in the same form as the entries;
+/// getIndex() and getState() convert between them and indices 0..n-1.
+class Dfa final
+{
+public: // types
+    using state_t = std::size_t;
+
+    static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+public: // methods
+    /// Builds the table of a deterministic FSM, in which every byte takes
+    /// the transitions of the byte it folds to
+    explicit Dfa(const Fsm &fsm, const ByteFold &fold = identityFold());
+
+    bool match(const char *data, std::size_t size) const;
+
+    /// Returns true as soon as a prefix of the input is accepted. For a DFA
+    /// built by unanchored() that means the input contains a match.
+    bool search(const char *data, std::size_t size) const;
+
+    /// Returns the length of the longest accepted prefix of the input, or
+    /// npos if no prefix is accepted
+    std::size_t matchLongest(const char *data, std::size_t size) const;
+
+    /// Matches every string of the batch, storing the results in out. The
+    /// strings are walked through the table in interleaved lanes so that
+    /// independent lookups overlap instead of waiting on each other.
+    void matchBatch(
+        const std::vector<std::string_view> &strs,
+        std::vector<bool> &out) const;
+
+    /// Builds a DFA accepting every input that ends with a match of this
+    /// one, by the subset construction of the states active after trying a
+    /// match at every position. With absorbing set, final states are never
+    /// left, so that it accepts every input that contains a match. Returns
+    /// null if it would have more than max_states states.
+    std::unique_ptr<Dfa> unanchored(
+        std::size_t max_states,
+        bool absorbing = true) const;
+
+    /// Builds a DFA that accepts wherever the leftmost-longest match seen
+    /// so far ends, so that its matchLongest() is the end of the
+    /// leftmost-longest match in the input. Its states list the states of
+    /// this DFA still reachable from every start, earliest start first, and
+    /// the starts after the first one to match are dropped. Returns null if
+    /// it would have more than max_states states.
+    std::unique_ptr<Dfa> leftmostLongest(std::size_t max_states) const;
+
+    std::size_t getStateCount() const;
+    std::size_t getClassCount() const;
+
+    /// Returns the class of every byte
+    const std::array<std::uint8_t, 256> &getClasses() const;
+
+    /// Size of a table entry in bytes
+    std::size_t getEntryWidth() const;
+    bool isPremultiplied() const;
+
+    state_t getStartingState() const;
+
+    /// Returns the state that rejects every input, or npos if there is none
+    state_t getDeadState() const;
+    bool isFinal(state_t state) const;
+
+    /// Returns true if the state rejects every input
+    bool isDead(state_t state) const;
+
+    /// Returns true if the state accepts every input
+    bool isAbsorbing(state_t state) const;
+
+    state_t getState(std::size_t index) const;
+    std::size_t getIndex(state_t state) const;
+
+    state_t next(state_t state, unsigned char byte) const
+    {
+        std::size_t offset = (m_premultiplied ? state : state * m_class_count) +
+                             m_classes[byte];
+
+        switch (m_width)
+        {
+        case 1:
+            return load<std::uint8_t>(offset);
+        case 2:
+            return load<std::uint16_t>(offset);
+        case 4:
+            return load<std::uint32_t>(offset);
+        default:
+            return load<std::uint64_t>(offset);
+        }
+    }
+
+private: // methods
+    Dfa() = default;
+
+    /// Stores the table given as successors[index * class count + class].
+    /// States are numbered dead first, with the given dead state leading,
+    /// then the other non-final ones, then final ones, absorbing ones last.
+    void layout(
+        const std::vector<std::size_t> &successors,
+        const std::vector<bool> &final,
+        std::size_t start,
+        std::size_t dead);
+
+    /// Calls function with a typed view of the table and returns its result
+    template <class Function>
+    auto visitTable(Function &&function) const;
+
+    template <bool Premultiplied, class Function>
+    auto visitWidth(Function &&function) const;
+
+    template <class T>
+    T load(std::size_t offset) const
+    {
+        T entry;
+        std::memcpy(&entry, m_table.data() + offset * sizeof(T), sizeof(T));
+        return entry;
+    }
+
+    template <class T>
+    void store(std::size_t offset, std::size_t entry)
+    {
+        T narrow = static_cast<T>(entry);
+        std::memcpy(m_table.data() + offset * sizeof(T), &narrow, sizeof(T));
+    }
+
+private: // fields
+    std::array<std::uint8_t, 256> m_classes;
+    std::size_t m_class_count;
+    std::vector<unsigned char> m_table;
+    std::size_t m_width;
+    bool m_premultiplied;
+    std::size_t m_state_count;
+    state_t m_start;
+    state_t m_dead;
+    state_t m_first_live;
+    state_t m_first_final;
+    state_t m_first_absorbing;
+};
+
+} // namespace fsm
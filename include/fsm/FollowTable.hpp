@@ -0,0 +1,45 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace fsm {
+
+/// Follow sets of up to 64 states, for bit-parallel automata.
+///
+/// The states are split into chunks of 8, and every chunk has the union of
+/// the follow sets of each of its 256 subsets, so that following a set of
+/// states costs one lookup per chunk rather than one per active state.
+class FollowTable final
+{
+public: // types
+    using mask_t = std::uint64_t;
+
+public: // methods
+    FollowTable() = default;
+
+    /// Builds the table of the given follow sets, follow[p] being the set
+    /// of state p
+    explicit FollowTable(const std::vector<mask_t> &follow);
+
+    /// Returns the union of the follow sets of the given states
+    mask_t follow(mask_t states) const
+    {
+        mask_t result = 0;
+
+        for (const auto &table : m_chunks)
+        {
+            result |= table[states & 0xff];
+            states >>= 8;
+        }
+
+        return result;
+    }
+
+private: // fields
+    std::vector<std::array<mask_t, 256>> m_chunks;
+};
+
+} // namespace fsm
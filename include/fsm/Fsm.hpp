@@ -1,72 +1,220 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <map>
+#include <memory>
+#include <memory_resource>
 #include <ostream>
 #include <set>
+#include <utility>
 #include <vector>
 
+/// Width of Fsm state ids in bits: 16, 32 or 64. Set by the build, which
+/// must use the same value for the library and its users.
+#ifndef FSM_STATE_BITS
+#define FSM_STATE_BITS 32
+#endif
+
 namespace fsm {
 
+/// Unsigned type of state ids with the given number of bits
+template <unsigned Bits>
+struct StateId;
+
+template <>
+struct StateId<16>
+{
+    using type = std::uint16_t;
+};
+
+template <>
+struct StateId<32>
+{
+    using type = std::uint32_t;
+};
+
+template <>
+struct StateId<64>
+{
+    using type = std::uint64_t;
+};
+
+/// Finite state machine over bytes, stored as a matrix of edge labels.
+///
+/// All containers of an FSM allocate from the memory resource it was
+/// constructed with, and the FSMs built from it by rev(), det(), simplify()
+/// and the combinators allocate from the same one. That lets a whole
+/// compilation run in an arena such as std::pmr::monotonic_buffer_resource
+/// that is released at once. As with std::pmr containers, a plain copy uses
+/// the default resource.
 class Fsm final
 {
 public: // types
-    using state_t = std::size_t;
+    /// The largest value is reserved for npos, so an FSM has fewer states
+    /// than that. Constructing a larger one throws std::runtime_error.
+    using state_t = StateId<FSM_STATE_BITS>::type;
     using symbol_t = char;
 
+    using allocator_type = std::pmr::polymorphic_allocator<std::byte>;
+    using symbol_set_t = std::pmr::set<symbol_t>;
+    using state_set_t = std::pmr::set<state_t>;
+    using transitions_t = std::pmr::vector<std::pmr::vector<symbol_set_t>>;
+
+    static constexpr state_t npos = static_cast<state_t>(-1);
+
+    /// Passes of simplify(), run in the order they are listed
+    enum Pass : unsigned
+    {
+        RemoveEpsilons = 1 << 0, ///< Replace epsilon edges by direct edges
+        Trim = 1 << 1,           ///< Drop unreachable and dead states
+        MergeStates = 1 << 2,    ///< Merge forward and backward bisimilar states
+        AllPasses = RemoveEpsilons | Trim | MergeStates,
+    };
+
 public: // methods
     explicit Fsm(
         std::size_t states,
-        const std::set<state_t> &s = {},
-        const std::set<state_t> &f = {});
+        const state_set_t &s = {},
+        const state_set_t &f = {},
+        allocator_type alloc = {});
 
     explicit Fsm(
         const std::vector<std::vector<std::set<symbol_t>>> &t,
-        const std::set<state_t> &s = {},
-        const std::set<state_t> &f = {});
+        const state_set_t &s = {},
+        const state_set_t &f = {},
+        allocator_type alloc = {});
 
     explicit Fsm(
         const std::set<symbol_t> &a,
         const std::vector<std::vector<std::vector<state_t>>> &t,
-        const std::set<state_t> &s = {},
-        const std::set<state_t> &f = {});
+        const state_set_t &s = {},
+        const state_set_t &f = {},
+        allocator_type alloc = {});
+
+    /// Copies other into the given resource
+    Fsm(const Fsm &other, allocator_type alloc);
+
+    allocator_type get_allocator() const;
 
     void connect(state_t s1, state_t s2, symbol_t a);
     void setStarting(state_t state, bool value = true);
     void setFinal(state_t state, bool value = true);
 
-    std::vector<std::vector<std::set<symbol_t>>> getTransitions() const;
-    std::set<state_t> getStartingStates() const;
-    std::set<state_t> getFinalStates() const;
+    const transitions_t &getTransitions() const;
+    const state_set_t &getStartingStates() const;
+    const state_set_t &getFinalStates() const;
 
     Fsm rev() const;
     Fsm det() const;
+
+    /// Same as det(), also storing in subsets the set of states of this FSM
+    /// that every state of the result stands for
+    Fsm det(std::pmr::vector<state_set_t> &subsets) const;
+
+    /// Same as det(), with the subset construction spread over the given
+    /// number of threads (0 for one per hardware thread) once the DFA turns
+    /// out large enough to pay for them. States are numbered exactly as by
+    /// det().
+    Fsm detParallel(std::size_t threads = 0) const;
     Fsm min() const;
 
+    /// Same as min(), or null once one of the deterministic FSMs it goes
+    /// through would have more than max_states states
+    std::unique_ptr<Fsm> min(std::size_t max_states) const;
+
+    /// Returns an equivalent FSM with fewer states and edges, densely
+    /// renumbered. Cheaper than det() and makes it cheaper.
+    Fsm simplify(unsigned passes = AllPasses) const;
+
     friend std::ostream &operator<<(std::ostream &stream, const Fsm &fsm);
 
-    static Fsm concatenation(const std::vector<Fsm> &fsms);
-    static Fsm disjunction(const std::vector<Fsm> &fsms);
+    static Fsm concatenation(
+        const std::vector<Fsm> &fsms,
+        allocator_type alloc = {});
+
+    static Fsm disjunction(
+        const std::vector<Fsm> &fsms,
+        allocator_type alloc = {});
+
     static Fsm option(const Fsm &fsm);
     static Fsm iteration(const Fsm &fsm);
 
+private: // types
+    /// Edges of every state as (symbol, other state) pairs sorted by symbol
+    using edges_t =
+        std::pmr::vector<std::pmr::vector<std::pair<symbol_t, state_t>>>;
+
 private: // methods
+    static void checkStateCount(std::size_t states);
+
+    /// Indexes the outgoing edges (incoming if backward) of every state, so
+    /// that the successors by a symbol are found without scanning a row of
+    /// the matrix. Algorithms build it once and use it for every lookup.
+    edges_t buildEdges(bool backward = false) const;
+
     void buildAlphabet();
 
     void printState(std::ostream &stream, state_t state) const;
-    std::vector<std::set<state_t>> epsilonClosures() const;
+    std::pmr::vector<state_set_t> epsilonClosures(const edges_t &edges) const;
+
+    /// Returns the closures of the successors of subset by a, allocated
+    /// from the resource of subset
+    state_set_t successors(
+        const state_set_t &subset,
+        symbol_t a,
+        const std::pmr::vector<state_set_t> &closures,
+        const edges_t &edges) const;
 
-    void buildEpsilonClosures(
+    void buildEpsilonClosure(
         state_t state,
-        std::vector<std::set<state_t>> &ec,
-        std::vector<bool> &flags) const;
+        state_set_t &closure,
+        const edges_t &edges) const;
+
+    /// Same as det(), or null if the result would have more than
+    /// max_states states
+    std::unique_ptr<Fsm> detBounded(std::size_t max_states) const;
+
+    /// Runs the subset construction, storing in q the subsets and in rows
+    /// their successors as for fromRows(). Returns false, leaving both
+    /// incomplete, once there are more than max_states subsets.
+    bool buildSubsets(
+        std::pmr::vector<state_set_t> &q,
+        std::pmr::vector<std::pmr::vector<state_t>> &rows,
+        std::size_t max_states) const;
+
+    /// Builds the deterministic FSM of complete subsets and rows
+    Fsm fromSubsets(
+        const std::pmr::vector<state_set_t> &q,
+        const std::pmr::vector<std::pmr::vector<state_t>> &rows) const;
+
+    /// Builds a deterministic FSM over the alphabet of this one, starting in
+    /// state 0, where rows[s][i] is the successor of s by the i-th symbol of
+    /// the alphabet or npos
+    Fsm fromRows(
+        const std::pmr::vector<std::pmr::vector<state_t>> &rows,
+        const state_set_t &f) const;
 
     void ensureAtomic() const;
 
+    Fsm removeEpsilons() const;
+    Fsm trim() const;
+    std::pmr::vector<state_t> bisimulation(bool backward) const;
+
+    /// Maps every state s to blocks[s], dropping states mapped to npos
+    Fsm quotient(const std::pmr::vector<state_t> &blocks) const;
+
 private: // fields
-    std::set<symbol_t> m_alphabet;
-    std::vector<std::vector<std::set<symbol_t>>> m_transitions;
-    std::set<state_t> m_starting_states;
-    std::set<state_t> m_final_states;
+    symbol_set_t m_alphabet;
+    transitions_t m_transitions;
+    state_set_t m_starting_states;
+    state_set_t m_final_states;
+};
+
+/// Hash of a set of states, for unordered containers of subsets
+struct SubsetHash
+{
+    std::size_t operator()(const Fsm::state_set_t &subset) const;
 };
 
 } // namespace fsm
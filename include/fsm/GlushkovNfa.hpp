@@ -0,0 +1,80 @@
+#pragma once
+
+#include <array>
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "fsm/ByteFold.hpp"
+#include "fsm/FollowTable.hpp"
+
+namespace fsm {
+
+/// Bit-parallel simulation of a position (Glushkov) automaton.
+///
+/// Every state of the automaton is a bit of one machine word: bit 0 is the
+/// initial state and bit p the state reached after reading position p of
+/// the pattern. A step is the union of the follow sets of the active states,
+/// looked up 8 states at a time, masked with the states that may read the
+/// input byte. No determinization is needed.
+class GlushkovNfa final
+{
+public: // types
+    using mask_t = std::uint64_t;
+
+    static const std::size_t MaxPositions = 63;
+    static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+    class Builder final
+    {
+    public: // methods
+        Builder();
+
+        /// Adds a position reading the given bytes and returns its bit, or 0
+        /// once the pattern has more than MaxPositions positions.
+        mask_t addPosition(const std::bitset<256> &symbols);
+
+        /// Makes every position of to follow every position of from.
+        void addFollow(mask_t from, mask_t to);
+
+        bool overflow() const;
+        std::size_t getPositionCount() const;
+
+        /// Builds the automaton, in which every byte is read as the byte
+        /// it folds to
+        GlushkovNfa build(
+            mask_t first,
+            mask_t last,
+            bool nullable,
+            const ByteFold &fold = identityFold()) const;
+
+    private: // fields
+        std::vector<std::bitset<256>> m_symbols;
+        std::vector<mask_t> m_follow;
+        bool m_overflow;
+    };
+
+public: // methods
+    bool match(const char *data, std::size_t size) const;
+
+    /// Returns true if the input contains a match
+    bool search(const char *data, std::size_t size) const;
+
+    /// Returns the length of the longest accepted prefix of the input, or
+    /// npos if no prefix is accepted
+    std::size_t matchLongest(const char *data, std::size_t size) const;
+
+private: // methods
+    GlushkovNfa(
+        const std::vector<std::bitset<256>> &symbols,
+        const std::vector<mask_t> &follow,
+        mask_t final,
+        const ByteFold &fold);
+
+private: // fields
+    std::array<mask_t, 256> m_symbols;
+    FollowTable m_follow;
+    mask_t m_final;
+};
+
+} // namespace fsm
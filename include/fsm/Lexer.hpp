@@ -0,0 +1,58 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace fsm {
+
+/// Maximal munch tokenizer compiled from a list of token rules.
+///
+/// All rules are compiled into a single minimized DFA whose final states
+/// carry the token of the winning rule: the one with the highest priority,
+/// or the earliest one among rules of equal priority.
+class Lexer final
+{
+public: // types
+    using state_t = std::size_t;
+
+    /// Token id of a byte that does not start any token
+    static constexpr int Error = -1;
+
+    struct Rule
+    {
+        std::string pattern;
+        int token; ///< Non-negative token id
+        int priority;
+    };
+
+    struct Token
+    {
+        int id;
+        const char *begin;
+        std::size_t size;
+    };
+
+public: // methods
+    explicit Lexer(const std::vector<Rule> &rules);
+
+    /// Scans the longest token starting at pos and advances pos past it.
+    /// Bytes that do not start a token are returned one at a time as Error
+    /// tokens. Returns false at the end of the input. Rules matching the
+    /// empty string never produce empty tokens.
+    bool next(const char *&pos, const char *end, Token &token) const;
+
+    std::size_t getStateCount() const;
+
+private: // fields
+    std::array<std::uint8_t, 256> m_classes;
+    std::size_t m_class_count;
+    std::vector<state_t> m_table;
+    std::vector<int> m_tokens;
+    state_t m_start;
+    state_t m_dead;
+};
+
+} // namespace fsm
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace fsm {
+
+/// Matcher for patterns that stand for a finite set of literal strings.
+///
+/// Whole-input matches are plain comparisons. Searching for a single
+/// literal compares 16 candidate positions at a time by their first and
+/// last bytes with SSE2 before checking them, while sets of literals are
+/// searched with an Aho-Corasick automaton over byte classes.
+class LiteralMatcher final
+{
+public: // types
+    static const std::size_t MaxLiterals = 256;
+    static const std::size_t MaxStates = 4096;
+
+public: // methods
+    explicit LiteralMatcher(const std::vector<std::string> &literals);
+
+    /// Returns false if the literals need too large an automaton
+    static bool fits(const std::vector<std::string> &literals);
+
+    /// Returns true if the whole input is one of the literals
+    bool match(const char *data, std::size_t size) const;
+
+    /// Returns true if the input contains one of the literals
+    bool search(const char *data, std::size_t size) const;
+
+private: // methods
+    bool searchLiteral(const char *data, std::size_t size) const;
+    bool searchSet(const char *data, std::size_t size) const;
+
+    void buildAutomaton();
+
+private: // fields
+    std::vector<std::string> m_literals;
+
+    std::array<std::uint8_t, 256> m_classes;
+    std::size_t m_class_count;
+    std::vector<std::uint32_t> m_table;
+    std::vector<bool> m_final;
+};
+
+} // namespace fsm
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace fsm {
+
+class Program;
+
+/// Submatch engine for one-pass programs.
+///
+/// A program is one-pass when, at every input position, at most one thread
+/// can consume the next byte and the end of the input is reached by at most
+/// one path. Such a program is a DFA whose transitions carry the capture
+/// slots to record, so submatches come out of a single walk over the input.
+class OnePassDfa final
+{
+public: // types
+    using mask_t = std::uint64_t;
+
+    static const std::size_t MaxSlots = 64;
+
+public: // methods
+    /// Returns null if the program is not one-pass
+    static std::unique_ptr<OnePassDfa> build(const Program &program);
+
+    bool match(
+        const char *data,
+        std::size_t size,
+        std::vector<std::size_t> &slots) const;
+
+private: // types
+    struct Transition
+    {
+        std::uint32_t next;
+        mask_t actions;
+    };
+
+    struct State
+    {
+        bool final;
+        mask_t actions;
+    };
+
+private: // methods
+    OnePassDfa() = default;
+
+private: // fields
+    std::array<std::uint8_t, 256> m_classes;
+    std::size_t m_class_count;
+    std::vector<Transition> m_table;
+    std::vector<State> m_states;
+    std::size_t m_slot_count;
+};
+
+} // namespace fsm
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <bitset>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "fsm/ByteFold.hpp"
+
+namespace fsm {
+
+/// Instruction list of a pattern with capture groups, executed by a Pike VM.
+///
+/// The program follows Thompson's construction: Consume and Save fall
+/// through to the next instruction, Split forks a lower priority thread at
+/// y after trying x. Save records the current input position in a capture
+/// slot; group k occupies slots 2k and 2k+1, group 0 being the whole match.
+class Program final
+{
+public: // types
+    static constexpr std::size_t npos = std::string::npos;
+
+    enum class Opcode
+    {
+        Consume,
+        Split,
+        Jump,
+        Save,
+        Match,
+    };
+
+    struct Instruction
+    {
+        Opcode opcode;
+        std::bitset<256> symbols;
+        std::size_t x;
+        std::size_t y;
+    };
+
+    /// Thread lists of the VM, reusable across runs
+    class Threads final
+    {
+    private: // fields
+        friend class Program;
+
+        std::vector<std::size_t> m_sparse[2];
+        std::vector<std::size_t> m_dense[2];
+        std::vector<std::size_t> m_slots[2];
+        std::size_t m_size[2];
+        std::vector<std::size_t> m_current;
+    };
+
+public: // methods
+    /// Creates an empty program for the given number of capture groups,
+    /// whose Consume instructions also accept every byte folded to one of
+    /// their symbols
+    explicit Program(std::size_t groups, const ByteFold &fold = identityFold());
+
+    std::size_t consume(const std::bitset<256> &symbols);
+    std::size_t split();
+    std::size_t jump();
+    std::size_t save(std::size_t slot);
+    std::size_t match();
+
+    Instruction &operator[](std::size_t pc);
+    const Instruction &operator[](std::size_t pc) const;
+
+    std::size_t size() const;
+    std::size_t getSlotCount() const;
+
+    /// Matches the whole input, filling slots with the leftmost-first
+    /// (Perl-like) submatch positions
+    bool run(
+        const char *data,
+        std::size_t size,
+        std::vector<std::size_t> &slots,
+        Threads &threads) const;
+
+    /// Returns the length of the longest prefix of the input matching the
+    /// program, or npos if there is none
+    std::size_t matchLongest(
+        const char *data,
+        std::size_t size,
+        Threads &threads) const;
+
+private: // methods
+    std::size_t emit(Opcode opcode);
+
+    /// Empties the thread lists and adds the initial thread to the first
+    void start(Threads &threads) const;
+
+    void addThread(
+        Threads &threads,
+        std::size_t list,
+        std::size_t pc,
+        std::size_t pos) const;
+
+private: // fields
+    std::vector<Instruction> m_instructions;
+    std::size_t m_slot_count;
+    ByteFold m_fold;
+};
+
+} // namespace fsm
@@ -1,23 +1,126 @@
 #pragma once
 
+#include <cstddef>
 #include <memory>
+#include <memory_resource>
 #include <string>
+#include <string_view>
+#include <vector>
 
 namespace fsm {
 
 class Fsm;
 class RegexImpl;
+class ScratchImpl;
 
+/// Compiled regular expression.
+///
+/// A Regex is an immutable handle to a reference-counted compiled program:
+/// copies are cheap and a single instance may be matched against from any
+/// number of threads at once.
 class Regex final
 {
+public: // types
+    static constexpr std::size_t npos = std::string::npos;
+
+    enum Flags : unsigned
+    {
+        NoFlags = 0,
+        NoCache = 1 << 0,    ///< Always compile, bypassing the pattern cache
+        IgnoreCase = 1 << 1, ///< Match ASCII letters regardless of case
+        Deferred = 1 << 2,   ///< Build the DFA in the background, see below
+    };
+
+    /// Part of the subject matched by a capture group, [npos, npos] if the
+    /// group did not participate in the match
+    struct Submatch
+    {
+        std::size_t begin;
+        std::size_t end;
+    };
+
+    /// Thread lists and capture slots of the NFA engines, kept so that
+    /// repeated matches do not allocate. Any regex can use any Scratch, but
+    /// each thread needs one of its own.
+    class Scratch final
+    {
+    public: // methods
+        Scratch();
+        ~Scratch();
+
+        Scratch(Scratch &&other);
+        Scratch &operator=(Scratch &&other);
+
+    private: // fields
+        friend class RegexImpl;
+        std::unique_ptr<ScratchImpl> m_impl;
+    };
+
 public: // methods
-    Regex(const std::string &pattern);
-    bool match(const std::string &str);
+    /// Compiles the pattern. With Deferred, the constructor only parses it
+    /// and the DFA is built by a background thread; until then the regex is
+    /// usable but matched by slower NFA simulation.
+    Regex(const std::string &pattern, unsigned flags = NoFlags);
+
+    /// Compiles the patterns with the given number of threads (0 for one
+    /// per hardware thread). Throws the error of the first invalid pattern.
+    static std::vector<Regex> compileAll(
+        const std::vector<std::string> &patterns,
+        unsigned flags = NoFlags,
+        std::size_t threads = 0);
+
+    bool match(const std::string &str) const;
+    bool match(const std::string &str, Scratch &scratch) const;
+
+    /// Matches str and extracts the capture groups, submatches[0] being the
+    /// whole string and submatches[k] the k-th parenthesized group. Groups
+    /// opened with "(?:" do not capture.
+    bool match(const std::string &str, std::vector<Submatch> &submatches)
+        const;
+    bool match(
+        const std::string &str,
+        std::vector<Submatch> &submatches,
+        Scratch &scratch) const;
+
+    /// Returns true if some substring of str matches the pattern
+    bool search(const std::string &str) const;
+
+    /// Finds the leftmost-longest match starting at or after pos
+    bool find(const std::string &str, Submatch &match, std::size_t pos = 0)
+        const;
+
+    /// Finds all non-overlapping leftmost-longest matches, left to right
+    std::vector<Submatch> findAll(const std::string &str) const;
+
+    std::size_t getCaptureCount() const;
+
+    /// Returns false while the DFA and span finder of a Deferred regex are
+    /// being built
+    bool isCompiled() const;
+
+    /// Matches a batch of strings at once, out[i] being the result for
+    /// strs[i]. Cheaper than separate calls for many short strings.
+    void matchBatch(
+        const std::vector<std::string_view> &strs,
+        std::vector<bool> &out) const;
+
+    /// Compiles the pattern to an NFA whose containers, and those of the
+    /// FSMs derived from it, allocate from the given resource
+    static Fsm buildFsm(
+        const std::string &pattern,
+        std::pmr::memory_resource *resource = std::pmr::get_default_resource());
+
+    static void setCacheCapacity(std::size_t capacity);
+    static void clearCache();
+
+    /// Returns the number of patterns in the cache
+    static std::size_t getCacheSize();
 
-    static Fsm buildFsm(const std::string &pattern);
+private: // methods
+    explicit Regex(std::shared_ptr<const RegexImpl> impl);
 
 private: // fields
-    std::unique_ptr<RegexImpl> m_impl;
+    std::shared_ptr<const RegexImpl> m_impl;
 };
 
 } // namespace fsm
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+
+namespace fsm {
+
+class Dfa;
+
+/// Set of patterns matched together, supporting incremental updates.
+///
+/// Every pattern is compiled into its own DFA when it is added. Matching
+/// walks the product of all the DFAs, built lazily from the transitions the
+/// inputs actually take and thrown away whenever the set changes, so that
+/// adding or removing a pattern only costs the compilation of that pattern.
+/// Concurrent matches share the product and only serialize while adding to
+/// it.
+class RegexSet final
+{
+public: // types
+    using id_t = std::size_t;
+
+public: // methods
+    RegexSet();
+    ~RegexSet();
+
+    RegexSet(const RegexSet &) = delete;
+    RegexSet &operator=(const RegexSet &) = delete;
+
+    id_t add(const std::string &pattern);
+    void remove(id_t id);
+
+    /// Returns the ids of all patterns matching the whole string, in
+    /// ascending order
+    std::vector<id_t> match(const std::string &str) const;
+
+    std::size_t size() const;
+
+private: // types
+    static const std::size_t MaxProductStates = 4096;
+
+    using state_t = std::size_t;
+
+    struct ProductState
+    {
+        std::vector<state_t> states;
+        std::vector<id_t> matches;
+
+        /// Set when every DFA is dead or absorbing, so that the matches are
+        /// the same whatever input follows
+        bool decided;
+    };
+
+private: // methods
+    /// Recomputes the byte classes and empties the product after the set
+    /// of patterns changed
+    void rebuild();
+
+    /// Returns the id of the product state of the given DFA states, adding
+    /// it unless the product is full, in which case UnknownState is returned
+    std::uint32_t getProductState(const std::vector<state_t> &states) const;
+
+    /// Returns the successor of a product state for a byte, adding it as
+    /// getProductState() does
+    std::uint32_t addTransition(std::uint32_t state, unsigned char byte) const;
+
+    /// Empties the product, leaving only the starting state with id 0
+    void resetProduct() const;
+
+private: // fields
+    /// Held shared while matching, and exclusively to change the set or to
+    /// flush the product
+    mutable std::shared_mutex m_mutex;
+
+    std::map<id_t, std::shared_ptr<const Dfa>> m_patterns;
+    id_t m_next_id;
+    std::size_t m_version;
+
+    std::vector<const Dfa *> m_dfas;
+    std::vector<id_t> m_ids;
+
+    /// Bytes in the same class of every DFA share a product class
+    std::array<std::uint8_t, 256> m_classes;
+    std::size_t m_class_count;
+
+    // Lazily built product of the pattern DFAs, in the iteration order of
+    // m_patterns. Matches add states and transitions under m_product_mutex
+    // and read transitions without it, a transition being published only
+    // once its target state is complete.
+    mutable std::mutex m_product_mutex;
+    mutable std::map<std::vector<state_t>, std::uint32_t> m_product_ids;
+    mutable std::size_t m_product_size;
+    std::unique_ptr<ProductState[]> m_product;
+    std::unique_ptr<std::atomic<std::uint32_t>[]> m_product_table;
+};
+
+} // namespace fsm
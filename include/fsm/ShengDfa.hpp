@@ -0,0 +1,52 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+namespace fsm {
+
+class Dfa;
+
+/// Execution engine for DFAs with at most 16 states.
+///
+/// Every input byte owns a 16 byte vector whose lane s holds the successor
+/// of state s, so that one step of the automaton is a single byte shuffle
+/// (pshufb) of that vector by the current state. CPUs without SSSE3 run the
+/// same tables with scalar lookups.
+///
+/// The input is run in blocks, and matching stops after the first block
+/// that ends in a dead or absorbing state, which decides the result.
+class ShengDfa final
+{
+public: // types
+    static const std::size_t MaxStates = 16;
+
+public: // methods
+    explicit ShengDfa(const Dfa &dfa);
+
+    static bool fits(const Dfa &dfa);
+
+    bool match(const char *data, std::size_t size) const;
+
+    /// Matches every string of the batch, storing the results in out. Four
+    /// strings at a time are stepped together by scalar lookups, which lets
+    /// the CPU overlap them; on short strings that beats one shuffle chain.
+    void matchBatch(
+        const std::vector<std::string_view> &strs,
+        std::vector<bool> &out) const;
+
+private: // types
+    static const std::size_t BlockSize = 64;
+
+private: // fields
+    alignas(16) std::array<std::array<std::uint8_t, MaxStates>, 256> m_masks;
+    std::uint8_t m_start;
+    std::uint16_t m_final;
+    std::uint16_t m_decided;
+    bool m_simd;
+};
+
+} // namespace fsm
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include <vector>
+#include "fsm/Dfa.hpp"
+
+namespace fsm {
+
+class Fsm;
+
+/// Finds the leftmost-longest matches of a pattern in a text.
+///
+/// A DFA whose states follow every start not yet ruled out, built by
+/// Dfa::leftmostLongest(), is run forward from the search position and
+/// reports where the leftmost-longest match ends. The DFA of the reversed
+/// pattern is then run backwards from that end, and its last accepting
+/// position is where the match starts. Neither pass reads past the point
+/// where the match is decided, so finding every match in turn is linear for
+/// most patterns, and neither needs backtracking or NFA simulation.
+class SpanFinder final
+{
+public: // types
+    using span_t = std::pair<std::size_t, std::size_t>;
+
+public: // methods
+    /// Builds the finder of the pattern of an FSM, in which every byte is
+    /// read as the byte it folds to, or returns null if one of its DFAs
+    /// would have more than max_states states
+    static std::unique_ptr<const SpanFinder> build(
+        const Fsm &fsm,
+        const ByteFold &fold,
+        std::size_t max_states);
+
+    /// Finds the leftmost-longest match starting at or after pos
+    bool find(
+        const char *data,
+        std::size_t size,
+        std::size_t pos,
+        span_t &span) const;
+
+    /// Finds all non-overlapping leftmost-longest matches, left to right
+    void findAll(const char *data, std::size_t size, std::vector<span_t> &spans)
+        const;
+
+private: // methods
+    SpanFinder(std::unique_ptr<const Dfa> forward, Dfa reverse);
+
+private: // fields
+    std::unique_ptr<const Dfa> m_forward;
+    Dfa m_reverse;
+};
+
+} // namespace fsm
@@ -0,0 +1,425 @@
+#include "fsm/ApproximateMatcher.hpp"
+#include <algorithm>
+#include <atomic>
+#include <bitset>
+#include <string>
+#include <utility>
+#include "fsm/ByteClasses.hpp"
+#include "fsm/Fsm.hpp"
+
+namespace fsm {
+
+static std::atomic<std::uint64_t> next_matcher_id{1};
+
+/// Returns the index of the lowest set bit of a non-zero word
+static std::size_t lowestBit(std::uint64_t word)
+{
+#if defined(__GNUC__)
+    return static_cast<std::size_t>(__builtin_ctzll(word));
+#else
+    std::size_t index = 0;
+
+    for (; !(word & 1); word >>= 1)
+    {
+        index++;
+    }
+
+    return index;
+#endif
+}
+
+ApproximateMatcher::Cache::Cache()
+    : m_owner{0}
+{
+}
+
+ApproximateMatcher::ApproximateMatcher(const Fsm &fsm, std::size_t errors)
+    : m_id{next_matcher_id.fetch_add(1, std::memory_order_relaxed)}
+    , m_errors{errors}
+{
+    Fsm simple = fsm.simplify();
+
+    const auto &transitions = simple.getTransitions();
+    const auto &final_states = simple.getFinalStates();
+    std::size_t states = transitions.size();
+
+    // A position is a state together with the bytes of an edge into it. A
+    // starting state also gets a position that no byte reads.
+    std::map<std::pair<std::size_t, std::string>, std::size_t> ids;
+    std::vector<std::size_t> position_states;
+    std::vector<std::string> position_symbols;
+
+    auto getPosition = [&](std::size_t state,
+                           const Fsm::symbol_set_t &symbols) {
+        std::string key(symbols.begin(), symbols.end());
+        auto it = ids.emplace(std::make_pair(state, key), ids.size()).first;
+
+        if (it->second == position_states.size())
+        {
+            position_states.push_back(state);
+            position_symbols.push_back(key);
+        }
+
+        return it->second;
+    };
+
+    std::vector<std::size_t> starting;
+
+    for (Fsm::state_t s : simple.getStartingStates())
+    {
+        starting.push_back(getPosition(s, {}));
+    }
+
+    for (std::size_t s1 = 0; s1 < states; s1++)
+    {
+        for (std::size_t s2 = 0; s2 < states; s2++)
+        {
+            if (!transitions[s1][s2].empty())
+            {
+                getPosition(s2, transitions[s1][s2]);
+            }
+        }
+    }
+
+    m_positions = position_states.size();
+    m_words = std::max<std::size_t>((m_positions + 63) / 64, 1);
+
+    auto set = [this](std::vector<mask_t> &sets, std::size_t i, std::size_t p) {
+        sets[i * m_words + p / 64] |= mask_t{1} << (p % 64);
+    };
+
+    m_starting.assign(m_words, 0);
+    m_final.assign(m_words, 0);
+    m_symbols.assign(256 * m_words, 0);
+    m_follow.assign(m_positions * m_words, 0);
+
+    for (std::size_t p : starting)
+    {
+        set(m_starting, 0, p);
+    }
+
+    for (std::size_t p = 0; p < m_positions; p++)
+    {
+        std::size_t s1 = position_states[p];
+
+        if (final_states.count(static_cast<Fsm::state_t>(s1)))
+        {
+            set(m_final, 0, p);
+        }
+
+        for (char c : position_symbols[p])
+        {
+            set(m_symbols, static_cast<unsigned char>(c), p);
+        }
+
+        for (std::size_t s2 = 0; s2 < states; s2++)
+        {
+            if (!transitions[s1][s2].empty())
+            {
+                set(m_follow, p, getPosition(s2, transitions[s1][s2]));
+            }
+        }
+    }
+
+    // Bytes with identical sets of positions are indistinguishable
+    m_classes.fill(0);
+    m_class_count = 1;
+
+    for (const std::string &symbols : position_symbols)
+    {
+        std::bitset<256> bytes;
+
+        for (char c : symbols)
+        {
+            bytes.set(static_cast<unsigned char>(c));
+        }
+
+        m_class_count = ByteClasses::refine(m_classes, bytes);
+    }
+
+    if (isBitParallel())
+    {
+        m_short_follow = FollowTable(m_follow);
+    }
+}
+
+bool ApproximateMatcher::match(const char *data, std::size_t size) const
+{
+    Cache cache;
+    return match(data, size, cache);
+}
+
+bool ApproximateMatcher::match(
+    const char *data,
+    std::size_t size,
+    Cache &cache) const
+{
+    if (isBitParallel())
+    {
+        return runShort(data, size, true);
+    }
+
+    return runLazy(data, size, true, cache);
+}
+
+bool ApproximateMatcher::search(const char *data, std::size_t size) const
+{
+    Cache cache;
+    return search(data, size, cache);
+}
+
+bool ApproximateMatcher::search(
+    const char *data,
+    std::size_t size,
+    Cache &cache) const
+{
+    if (isBitParallel())
+    {
+        return runShort(data, size, false);
+    }
+
+    return runLazy(data, size, false, cache);
+}
+
+std::size_t ApproximateMatcher::getPositionCount() const
+{
+    return m_positions;
+}
+
+bool ApproximateMatcher::isBitParallel() const
+{
+    return m_positions <= MaxShortPositions;
+}
+
+bool ApproximateMatcher::runShort(
+    const char *data,
+    std::size_t size,
+    bool anchored) const
+{
+    std::vector<mask_t> rows = initialRows();
+
+    mask_t restart = anchored ? 0 : m_starting[0];
+    mask_t final = m_final[0];
+
+    if (!anchored && (rows[m_errors] & final))
+    {
+        return true;
+    }
+
+    for (std::size_t i = 0; i < size; i++)
+    {
+        mask_t symbols = m_symbols[static_cast<unsigned char>(data[i])];
+        mask_t previous = rows[0];
+
+        rows[0] = (m_short_follow.follow(rows[0]) & symbols) | restart;
+
+        for (std::size_t e = 1; e <= m_errors; e++)
+        {
+            // A byte read with a matching position, an inserted byte, a
+            // substituted byte, and a deleted position
+            mask_t current = rows[e];
+            rows[e] = (m_short_follow.follow(current) & symbols) | previous |
+                      m_short_follow.follow(previous | rows[e - 1]) | restart;
+            previous = current;
+        }
+
+        // Rows only grow with the number of errors, so the last one tells
+        // whether anything is left and whether it matches
+        if (anchored && rows[m_errors] == 0)
+        {
+            return false;
+        }
+
+        if (!anchored && (rows[m_errors] & final))
+        {
+            return true;
+        }
+    }
+
+    return anchored && (rows[m_errors] & final);
+}
+
+bool ApproximateMatcher::runLazy(
+    const char *data,
+    std::size_t size,
+    bool anchored,
+    Cache &cache) const
+{
+    if (cache.m_owner != m_id)
+    {
+        cache.m_owner = m_id;
+        cache.m_anchored = Cache::Automaton();
+        cache.m_unanchored = Cache::Automaton();
+    }
+
+    Cache::Automaton &automaton =
+        anchored ? cache.m_anchored : cache.m_unanchored;
+
+    // The initial state is always the first one
+    if (automaton.rows.empty())
+    {
+        addState(automaton, initialRows());
+    }
+
+    std::size_t state = 0;
+    std::vector<mask_t> rows;
+
+    for (std::size_t i = 0; i < size; i++)
+    {
+        if (automaton.final[state] && !anchored)
+        {
+            return true;
+        }
+
+        if (automaton.dead[state])
+        {
+            return false;
+        }
+
+        unsigned char byte = static_cast<unsigned char>(data[i]);
+        std::size_t offset = state * m_class_count + m_classes[byte];
+
+        if (automaton.next[offset] == Cache::Unknown)
+        {
+            step(automaton.rows[state]->data(), byte, anchored, rows);
+
+            if (automaton.rows.size() >= MaxCacheStates)
+            {
+                std::vector<mask_t> current = *automaton.rows[state];
+
+                automaton = Cache::Automaton();
+                addState(automaton, initialRows());
+
+                state = addState(automaton, std::move(current));
+                offset = state * m_class_count + m_classes[byte];
+            }
+
+            std::size_t next = addState(automaton, std::move(rows));
+            automaton.next[offset] = next;
+        }
+
+        state = automaton.next[offset];
+    }
+
+    return automaton.final[state];
+}
+
+std::size_t ApproximateMatcher::addState(
+    Cache::Automaton &automaton,
+    std::vector<mask_t> rows) const
+{
+    auto inserted =
+        automaton.ids.emplace(std::move(rows), automaton.ids.size());
+    const auto &pair = *inserted.first;
+
+    if (inserted.second)
+    {
+        const mask_t *last = pair.first.data() + m_errors * m_words;
+
+        bool final = false;
+        bool dead = true;
+
+        for (std::size_t w = 0; w < m_words; w++)
+        {
+            final = final || (last[w] & m_final[w]);
+            dead = dead && last[w] == 0;
+        }
+
+        automaton.rows.push_back(&pair.first);
+        automaton.final.push_back(final);
+        automaton.dead.push_back(dead);
+        automaton.next.resize(
+            automaton.next.size() + m_class_count, Cache::Unknown);
+    }
+
+    return pair.second;
+}
+
+void ApproximateMatcher::step(
+    const mask_t *rows,
+    unsigned char byte,
+    bool anchored,
+    std::vector<mask_t> &result) const
+{
+    const mask_t *symbols = m_symbols.data() + byte * m_words;
+
+    std::vector<mask_t> moved(m_words);
+    std::vector<mask_t> either(m_words);
+
+    result.assign((m_errors + 1) * m_words, 0);
+
+    for (std::size_t e = 0; e <= m_errors; e++)
+    {
+        mask_t *next = result.data() + e * m_words;
+
+        follow(rows + e * m_words, moved.data());
+
+        for (std::size_t w = 0; w < m_words; w++)
+        {
+            next[w] = (moved[w] & symbols[w]) | (anchored ? 0 : m_starting[w]);
+        }
+
+        if (e == 0)
+        {
+            continue;
+        }
+
+        // Same recurrence as runShort(), a word at a time
+        const mask_t *previous = rows + (e - 1) * m_words;
+        const mask_t *next_previous = next - m_words;
+
+        for (std::size_t w = 0; w < m_words; w++)
+        {
+            either[w] = previous[w] | next_previous[w];
+        }
+
+        follow(either.data(), moved.data());
+
+        for (std::size_t w = 0; w < m_words; w++)
+        {
+            next[w] |= previous[w] | moved[w];
+        }
+    }
+}
+
+void ApproximateMatcher::follow(const mask_t *states, mask_t *result) const
+{
+    std::fill(result, result + m_words, 0);
+
+    for (std::size_t w = 0; w < m_words; w++)
+    {
+        for (mask_t bits = states[w]; bits; bits &= bits - 1)
+        {
+            std::size_t p = w * 64 + lowestBit(bits);
+            const mask_t *follow = m_follow.data() + p * m_words;
+
+            for (std::size_t v = 0; v < m_words; v++)
+            {
+                result[v] |= follow[v];
+            }
+        }
+    }
+}
+
+std::vector<ApproximateMatcher::mask_t> ApproximateMatcher::initialRows() const
+{
+    std::vector<mask_t> rows((m_errors + 1) * m_words, 0);
+    std::copy(m_starting.begin(), m_starting.end(), rows.begin());
+
+    for (std::size_t e = 1; e <= m_errors; e++)
+    {
+        const mask_t *previous = rows.data() + (e - 1) * m_words;
+        mask_t *current = rows.data() + e * m_words;
+
+        follow(previous, current);
+
+        for (std::size_t w = 0; w < m_words; w++)
+        {
+            current[w] |= previous[w];
+        }
+    }
+
+    return rows;
+}
+
+} // namespace fsm
@@ -0,0 +1,147 @@
+#include "fsm/ByteClasses.hpp"
+#include <map>
+#include <stdexcept>
+#include <utility>
+#include "fsm/Fsm.hpp"
+
+namespace fsm {
+
+ByteClasses::ByteClasses(const Fsm &fsm, const ByteFold &fold)
+{
+    const auto &transitions = fsm.getTransitions();
+
+    std::size_t states = transitions.size();
+    m_dead = states;
+
+    // Successor of every state for every byte, one column per byte
+    std::vector<std::vector<std::size_t>> columns(
+        256, std::vector<std::size_t>(states + 1, m_dead));
+
+    for (std::size_t s1 = 0; s1 < states; s1++)
+    {
+        for (std::size_t s2 = 0; s2 < states; s2++)
+        {
+            for (Fsm::symbol_t a : transitions[s1][s2])
+            {
+                std::size_t &next =
+                    columns[static_cast<unsigned char>(a)][s1];
+
+                if (a == '\0' || (next != m_dead && next != s2))
+                {
+                    throw std::runtime_error("FSM is not deterministic");
+                }
+
+                next = s2;
+            }
+        }
+    }
+
+    for (std::size_t byte = 0; byte < 256; byte++)
+    {
+        if (fold[byte] != byte)
+        {
+            columns[byte] = columns[fold[byte]];
+        }
+    }
+
+    // Bytes with identical columns are indistinguishable and share a class
+    std::map<std::vector<std::size_t>, std::size_t> class_ids;
+
+    for (std::size_t byte = 0; byte < 256; byte++)
+    {
+        auto it = class_ids.emplace(columns[byte], class_ids.size()).first;
+        m_classes[byte] = static_cast<std::uint8_t>(it->second);
+    }
+
+    m_class_count = class_ids.size();
+    m_successors.resize((states + 1) * m_class_count);
+
+    for (const auto &pair : class_ids)
+    {
+        for (std::size_t s = 0; s <= states; s++)
+        {
+            m_successors[s * m_class_count + pair.second] = pair.first[s];
+        }
+    }
+}
+
+std::uint8_t ByteClasses::getClass(unsigned char byte) const
+{
+    return m_classes[byte];
+}
+
+const std::array<std::uint8_t, 256> &ByteClasses::getClasses() const
+{
+    return m_classes;
+}
+
+std::size_t ByteClasses::getClassCount() const
+{
+    return m_class_count;
+}
+
+std::size_t ByteClasses::getStateCount() const
+{
+    return m_dead + 1;
+}
+
+std::size_t ByteClasses::getDeadState() const
+{
+    return m_dead;
+}
+
+std::size_t ByteClasses::next(std::size_t state, std::size_t cls) const
+{
+    return m_successors[state * m_class_count + cls];
+}
+
+const std::vector<std::size_t> &ByteClasses::getSuccessors() const
+{
+    return m_successors;
+}
+
+std::size_t ByteClasses::refine(
+    std::array<std::uint8_t, 256> &classes,
+    const std::array<std::uint8_t, 256> &other)
+{
+    std::map<std::pair<std::uint8_t, std::uint8_t>, std::size_t> class_ids;
+
+    for (std::size_t byte = 0; byte < 256; byte++)
+    {
+        auto key = std::make_pair(classes[byte], other[byte]);
+        auto it = class_ids.emplace(key, class_ids.size()).first;
+        classes[byte] = static_cast<std::uint8_t>(it->second);
+    }
+
+    return class_ids.size();
+}
+
+std::size_t ByteClasses::refine(
+    std::array<std::uint8_t, 256> &classes,
+    const std::bitset<256> &set)
+{
+    // New class of every old class, for bytes out of and in the set
+    std::array<std::array<int, 2>, 256> class_ids;
+    std::size_t count = 0;
+
+    for (auto &ids : class_ids)
+    {
+        ids.fill(-1);
+    }
+
+    for (std::size_t byte = 0; byte < 256; byte++)
+    {
+        int &id = class_ids[classes[byte]][set[byte]];
+
+        if (id < 0)
+        {
+            id = static_cast<int>(count++);
+        }
+
+        classes[byte] = static_cast<std::uint8_t>(id);
+    }
+
+    return count;
+}
+
+} // namespace fsm
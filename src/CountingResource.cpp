@@ -0,0 +1,61 @@
+#include "fsm/CountingResource.hpp"
+
+namespace fsm {
+
+CountingResource::CountingResource(std::pmr::memory_resource *upstream)
+    : m_upstream{upstream}
+    , m_allocations{0}
+    , m_deallocations{0}
+    , m_bytes{0}
+{
+}
+
+std::size_t CountingResource::getAllocationCount() const
+{
+    return m_allocations;
+}
+
+std::size_t CountingResource::getDeallocationCount() const
+{
+    return m_deallocations;
+}
+
+std::size_t CountingResource::getAllocatedBytes() const
+{
+    return m_bytes;
+}
+
+void CountingResource::reset()
+{
+    m_allocations = 0;
+    m_deallocations = 0;
+    m_bytes = 0;
+}
+
+void *CountingResource::do_allocate(std::size_t bytes, std::size_t alignment)
+{
+    void *p = m_upstream->allocate(bytes, alignment);
+
+    m_allocations.fetch_add(1, std::memory_order_relaxed);
+    m_bytes.fetch_add(bytes, std::memory_order_relaxed);
+
+    return p;
+}
+
+void CountingResource::do_deallocate(
+    void *p,
+    std::size_t bytes,
+    std::size_t alignment)
+{
+    m_upstream->deallocate(p, bytes, alignment);
+
+    m_deallocations.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool CountingResource::do_is_equal(
+    const std::pmr::memory_resource &other) const noexcept
+{
+    return this == &other;
+}
+
+} // namespace fsm
@@ -0,0 +1,678 @@
+#include "fsm/Dfa.hpp"
+#include <algorithm>
+#include <map>
+#include <stdexcept>
+#include "fsm/ByteClasses.hpp"
+#include "fsm/Fsm.hpp"
+
+namespace fsm {
+
+namespace {
+
+/// Table with entries of type T, as seen by the matching loops
+template <class T, bool Premultiplied>
+class TableView final
+{
+public: // methods
+    TableView(
+        const unsigned char *table,
+        const std::uint8_t *classes,
+        std::size_t class_count)
+        : m_table(table)
+        , m_classes(classes)
+        , m_class_count(class_count)
+    {
+    }
+
+    std::size_t next(std::size_t state, unsigned char byte) const
+    {
+        std::size_t offset = (Premultiplied ? state : state * m_class_count) +
+                             m_classes[byte];
+
+        T entry;
+        std::memcpy(&entry, m_table + offset * sizeof(T), sizeof(T));
+        return entry;
+    }
+
+private: // fields
+    const unsigned char *m_table;
+    const std::uint8_t *m_classes;
+    std::size_t m_class_count;
+};
+
+std::size_t widthOf(std::size_t value)
+{
+    if (value <= 0xff)
+    {
+        return 1;
+    }
+
+    if (value <= 0xffff)
+    {
+        return 2;
+    }
+
+    if (value <= 0xffffffff)
+    {
+        return 4;
+    }
+
+    return 8;
+}
+
+/// Returns for every state whether one of targets is reachable from it
+std::vector<bool> canReach(
+    const std::vector<std::size_t> &successors,
+    std::size_t class_count,
+    const std::vector<bool> &targets)
+{
+    std::size_t states = targets.size();
+    std::vector<std::vector<std::size_t>> predecessors(states);
+
+    for (std::size_t i = 0; i < successors.size(); i++)
+    {
+        predecessors[successors[i]].push_back(i / class_count);
+    }
+
+    std::vector<bool> reached = targets;
+    std::vector<std::size_t> stack;
+
+    for (std::size_t s = 0; s < states; s++)
+    {
+        if (targets[s])
+        {
+            stack.push_back(s);
+        }
+    }
+
+    while (!stack.empty())
+    {
+        std::size_t s = stack.back();
+        stack.pop_back();
+
+        for (std::size_t p : predecessors[s])
+        {
+            if (!reached[p])
+            {
+                reached[p] = true;
+                stack.push_back(p);
+            }
+        }
+    }
+
+    return reached;
+}
+
+} // namespace
+
+template <class Function>
+auto Dfa::visitTable(Function &&function) const
+{
+    if (m_premultiplied)
+    {
+        return visitWidth<true>(function);
+    }
+
+    return visitWidth<false>(function);
+}
+
+template <bool Premultiplied, class Function>
+auto Dfa::visitWidth(Function &&function) const
+{
+    const unsigned char *table = m_table.data();
+    const std::uint8_t *classes = m_classes.data();
+
+    switch (m_width)
+    {
+    case 1:
+        return function(TableView<std::uint8_t, Premultiplied>(
+            table, classes, m_class_count));
+    case 2:
+        return function(TableView<std::uint16_t, Premultiplied>(
+            table, classes, m_class_count));
+    case 4:
+        return function(TableView<std::uint32_t, Premultiplied>(
+            table, classes, m_class_count));
+    default:
+        return function(TableView<std::uint64_t, Premultiplied>(
+            table, classes, m_class_count));
+    }
+}
+
+Dfa::Dfa(const Fsm &fsm, const ByteFold &fold)
+{
+    const auto &transitions = fsm.getTransitions();
+    const auto &starting_states = fsm.getStartingStates();
+    const auto &final_states = fsm.getFinalStates();
+
+    if (starting_states.size() != 1)
+    {
+        throw std::runtime_error("FSM is not deterministic");
+    }
+
+    ByteClasses classes(fsm, fold);
+
+    m_classes = classes.getClasses();
+    m_class_count = classes.getClassCount();
+
+    std::size_t states = transitions.size();
+
+    std::vector<bool> final(states + 1, false);
+
+    for (Fsm::state_t s : final_states)
+    {
+        final[s] = true;
+    }
+
+    layout(
+        classes.getSuccessors(),
+        final,
+        *starting_states.begin(),
+        classes.getDeadState());
+}
+
+bool Dfa::match(const char *data, std::size_t size) const
+{
+    // A state is undecided if state - m_first_live < undecided, which is a
+    // single comparison per byte thanks to unsigned wraparound
+    std::size_t undecided = m_first_absorbing - m_first_live;
+
+    return visitTable([&](const auto &table) {
+        state_t state = m_start;
+
+        for (std::size_t i = 0; i < size && state - m_first_live < undecided;
+             i++)
+        {
+            state = table.next(state, static_cast<unsigned char>(data[i]));
+        }
+
+        return isFinal(state);
+    });
+}
+
+bool Dfa::search(const char *data, std::size_t size) const
+{
+    return visitTable([&](const auto &table) {
+        state_t state = m_start;
+
+        for (std::size_t i = 0; i < size && !isFinal(state); i++)
+        {
+            state = table.next(state, static_cast<unsigned char>(data[i]));
+
+            if (isDead(state))
+            {
+                return false;
+            }
+        }
+
+        return isFinal(state);
+    });
+}
+
+std::size_t Dfa::matchLongest(const char *data, std::size_t size) const
+{
+    return visitTable([&](const auto &table) {
+        state_t state = m_start;
+        std::size_t longest = isFinal(state) ? 0 : npos;
+
+        for (std::size_t i = 0; i < size; i++)
+        {
+            state = table.next(state, static_cast<unsigned char>(data[i]));
+
+            if (isDead(state))
+            {
+                break;
+            }
+
+            // Every longer prefix is accepted as well
+            if (isAbsorbing(state))
+            {
+                return size;
+            }
+
+            if (isFinal(state))
+            {
+                longest = i + 1;
+            }
+        }
+
+        return longest;
+    });
+}
+
+std::unique_ptr<Dfa> Dfa::unanchored(
+    std::size_t max_states,
+    bool absorbing) const
+{
+    std::unique_ptr<Dfa> dfa(new Dfa);
+    dfa->m_classes = m_classes;
+    dfa->m_class_count = m_class_count;
+
+    // Some byte of every class, to look successors up through next()
+    std::vector<unsigned char> bytes(m_class_count);
+
+    for (std::size_t byte = 256; byte-- > 0;)
+    {
+        bytes[m_classes[byte]] = static_cast<unsigned char>(byte);
+    }
+
+    std::map<std::vector<state_t>, std::size_t> ids;
+    std::vector<std::vector<state_t>> subsets;
+
+    auto getSubset = [&](std::vector<state_t> subset) {
+        std::sort(subset.begin(), subset.end());
+        subset.erase(std::unique(subset.begin(), subset.end()), subset.end());
+
+        auto it = ids.find(subset);
+
+        if (it != ids.end())
+        {
+            return it->second;
+        }
+
+        std::size_t id = subsets.size();
+        ids.emplace(subset, id);
+        subsets.push_back(subset);
+        return id;
+    };
+
+    getSubset({m_start});
+
+    std::vector<std::size_t> successors;
+    std::vector<bool> final;
+
+    for (std::size_t s = 0; s < subsets.size(); s++)
+    {
+        if (subsets.size() > max_states)
+        {
+            return nullptr;
+        }
+
+        bool accepting = false;
+
+        for (state_t q : subsets[s])
+        {
+            accepting = accepting || isFinal(q);
+        }
+
+        final.push_back(accepting);
+
+        for (std::size_t c = 0; c < m_class_count; c++)
+        {
+            // Once a match has been seen the input is accepted for good
+            if (accepting && absorbing)
+            {
+                successors.push_back(s);
+                continue;
+            }
+
+            std::vector<state_t> subset{m_start};
+
+            for (state_t q : subsets[s])
+            {
+                state_t next = this->next(q, bytes[c]);
+
+                if (!isDead(next))
+                {
+                    subset.push_back(next);
+                }
+            }
+
+            successors.push_back(getSubset(subset));
+        }
+    }
+
+    // The start state is always active, so no state is dead
+    dfa->layout(successors, final, 0, npos);
+
+    return dfa;
+}
+
+std::unique_ptr<Dfa> Dfa::leftmostLongest(std::size_t max_states) const
+{
+    std::unique_ptr<Dfa> dfa(new Dfa);
+    dfa->m_classes = m_classes;
+    dfa->m_class_count = m_class_count;
+
+    // Some byte of every class, to look successors up through next()
+    std::vector<unsigned char> bytes(m_class_count);
+
+    for (std::size_t byte = 256; byte-- > 0;)
+    {
+        bytes[m_classes[byte]] = static_cast<unsigned char>(byte);
+    }
+
+    // Whether a start has matched, after which no later start is tried,
+    // and the states of the starts in the running. A start in the same
+    // state as an earlier one can only make matches right of its matches.
+    using Candidates = std::pair<bool, std::vector<state_t>>;
+
+    std::map<Candidates, std::size_t> ids;
+    std::vector<Candidates> lists;
+
+    auto getCandidates = [&](Candidates candidates) {
+        std::vector<state_t> &states = candidates.second;
+
+        auto matched = std::find_if(
+            states.begin(), states.end(), [this](state_t q) {
+                return isFinal(q);
+            });
+
+        if (matched != states.end())
+        {
+            states.erase(matched + 1, states.end());
+            candidates.first = true;
+        }
+
+        auto it = ids.find(candidates);
+
+        if (it != ids.end())
+        {
+            return it->second;
+        }
+
+        std::size_t id = lists.size();
+        ids.emplace(candidates, id);
+        lists.push_back(candidates);
+        return id;
+    };
+
+    auto add = [](std::vector<state_t> &states, state_t q) {
+        if (std::find(states.begin(), states.end(), q) == states.end())
+        {
+            states.push_back(q);
+        }
+    };
+
+    Candidates initial{false, {}};
+
+    if (!isDead(m_start))
+    {
+        initial.second.push_back(m_start);
+    }
+
+    getCandidates(initial);
+
+    std::vector<std::size_t> successors;
+    std::vector<bool> final;
+
+    for (std::size_t s = 0; s < lists.size(); s++)
+    {
+        if (lists.size() > max_states)
+        {
+            return nullptr;
+        }
+
+        Candidates candidates = lists[s];
+        const std::vector<state_t> &states = candidates.second;
+
+        // Only the start that matched can be last in a list that holds a
+        // final state
+        final.push_back(!states.empty() && isFinal(states.back()));
+
+        for (std::size_t c = 0; c < m_class_count; c++)
+        {
+            Candidates next{candidates.first, {}};
+
+            for (state_t q : states)
+            {
+                state_t successor = this->next(q, bytes[c]);
+
+                if (!isDead(successor))
+                {
+                    add(next.second, successor);
+                }
+            }
+
+            if (!next.first && !isDead(m_start))
+            {
+                add(next.second, m_start);
+            }
+
+            successors.push_back(getCandidates(next));
+        }
+    }
+
+    auto dead = ids.find(Candidates{true, {}});
+
+    dfa->layout(
+        successors, final, 0, dead != ids.end() ? dead->second : npos);
+
+    return dfa;
+}
+
+void Dfa::matchBatch(
+    const std::vector<std::string_view> &strs,
+    std::vector<bool> &out) const
+{
+    static const std::size_t Lanes = 4;
+
+    out.assign(strs.size(), false);
+
+    std::size_t i = visitTable([&](const auto &table) {
+        auto step = [&](state_t state, char c) {
+            return table.next(state, static_cast<unsigned char>(c));
+        };
+
+        std::size_t i = 0;
+
+        for (; i + Lanes <= strs.size(); i += Lanes)
+        {
+            const char *p0 = strs[i + 0].data();
+            const char *p1 = strs[i + 1].data();
+            const char *p2 = strs[i + 2].data();
+            const char *p3 = strs[i + 3].data();
+
+            std::size_t common = std::min(
+                std::min(strs[i + 0].size(), strs[i + 1].size()),
+                std::min(strs[i + 2].size(), strs[i + 3].size()));
+
+            state_t s0 = m_start;
+            state_t s1 = m_start;
+            state_t s2 = m_start;
+            state_t s3 = m_start;
+
+            for (std::size_t k = 0; k < common; k++)
+            {
+                s0 = step(s0, p0[k]);
+                s1 = step(s1, p1[k]);
+                s2 = step(s2, p2[k]);
+                s3 = step(s3, p3[k]);
+            }
+
+            state_t states[Lanes] = {s0, s1, s2, s3};
+
+            for (std::size_t lane = 0; lane < Lanes; lane++)
+            {
+                const std::string_view &str = strs[i + lane];
+                state_t state = states[lane];
+
+                for (std::size_t k = common; k < str.size(); k++)
+                {
+                    state = step(state, str[k]);
+                }
+
+                out[i + lane] = isFinal(state);
+            }
+        }
+
+        return i;
+    });
+
+    for (; i < strs.size(); i++)
+    {
+        out[i] = match(strs[i].data(), strs[i].size());
+    }
+}
+
+std::size_t Dfa::getStateCount() const
+{
+    return m_state_count;
+}
+
+std::size_t Dfa::getClassCount() const
+{
+    return m_class_count;
+}
+
+const std::array<std::uint8_t, 256> &Dfa::getClasses() const
+{
+    return m_classes;
+}
+
+std::size_t Dfa::getEntryWidth() const
+{
+    return m_width;
+}
+
+bool Dfa::isPremultiplied() const
+{
+    return m_premultiplied;
+}
+
+Dfa::state_t Dfa::getStartingState() const
+{
+    return m_start;
+}
+
+Dfa::state_t Dfa::getDeadState() const
+{
+    return m_dead;
+}
+
+bool Dfa::isFinal(state_t state) const
+{
+    return state >= m_first_final;
+}
+
+bool Dfa::isDead(state_t state) const
+{
+    return state < m_first_live;
+}
+
+bool Dfa::isAbsorbing(state_t state) const
+{
+    return state >= m_first_absorbing;
+}
+
+Dfa::state_t Dfa::getState(std::size_t index) const
+{
+    return m_premultiplied ? index * m_class_count : index;
+}
+
+std::size_t Dfa::getIndex(state_t state) const
+{
+    return m_premultiplied ? state / m_class_count : state;
+}
+
+void Dfa::layout(
+    const std::vector<std::size_t> &successors,
+    const std::vector<bool> &final,
+    std::size_t start,
+    std::size_t dead)
+{
+    m_state_count = final.size();
+
+    std::vector<bool> non_final(m_state_count);
+
+    for (std::size_t s = 0; s < m_state_count; s++)
+    {
+        non_final[s] = !final[s];
+    }
+
+    const std::vector<bool> &live = canReach(successors, m_class_count, final);
+    const std::vector<bool> &rejecting =
+        canReach(successors, m_class_count, non_final);
+
+    std::vector<std::size_t> order;
+
+    if (dead != npos)
+    {
+        order.push_back(dead);
+    }
+
+    for (std::size_t s = 0; s < m_state_count; s++)
+    {
+        if (s != dead && !live[s])
+        {
+            order.push_back(s);
+        }
+    }
+
+    std::size_t first_live = order.size();
+
+    for (std::size_t s = 0; s < m_state_count; s++)
+    {
+        if (live[s] && !final[s])
+        {
+            order.push_back(s);
+        }
+    }
+
+    std::size_t first_final = order.size();
+
+    for (std::size_t s = 0; s < m_state_count; s++)
+    {
+        if (final[s] && rejecting[s])
+        {
+            order.push_back(s);
+        }
+    }
+
+    std::size_t first_absorbing = order.size();
+
+    for (std::size_t s = 0; s < m_state_count; s++)
+    {
+        if (!rejecting[s])
+        {
+            order.push_back(s);
+        }
+    }
+
+    std::vector<std::size_t> rank(m_state_count);
+
+    for (std::size_t i = 0; i < m_state_count; i++)
+    {
+        rank[order[i]] = i;
+    }
+
+    std::size_t last = m_state_count == 0 ? 0 : m_state_count - 1;
+    m_width = widthOf(last);
+    m_premultiplied = widthOf(last * m_class_count) == m_width;
+
+    m_table.resize(m_state_count * m_class_count * m_width);
+
+    for (std::size_t i = 0; i < m_state_count; i++)
+    {
+        for (std::size_t c = 0; c < m_class_count; c++)
+        {
+            std::size_t offset = i * m_class_count + c;
+            std::size_t entry =
+                getState(rank[successors[order[i] * m_class_count + c]]);
+
+            switch (m_width)
+            {
+            case 1:
+                store<std::uint8_t>(offset, entry);
+                break;
+            case 2:
+                store<std::uint16_t>(offset, entry);
+                break;
+            case 4:
+                store<std::uint32_t>(offset, entry);
+                break;
+            default:
+                store<std::uint64_t>(offset, entry);
+                break;
+            }
+        }
+    }
+
+    m_start = getState(rank[start]);
+    m_dead = dead == npos ? npos : getState(rank[dead]);
+    m_first_live = getState(first_live);
+    m_first_final = getState(first_final);
+    m_first_absorbing = getState(first_absorbing);
+}
+
+} // namespace fsm
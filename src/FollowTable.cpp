@@ -0,0 +1,29 @@
+#include "fsm/FollowTable.hpp"
+
+namespace fsm {
+
+FollowTable::FollowTable(const std::vector<mask_t> &follow)
+    : m_chunks((follow.size() + 7) / 8)
+{
+    for (std::size_t chunk = 0; chunk < m_chunks.size(); chunk++)
+    {
+        for (std::size_t bits = 0; bits < 256; bits++)
+        {
+            mask_t result = 0;
+
+            for (std::size_t i = 0; i < 8; i++)
+            {
+                std::size_t p = chunk * 8 + i;
+
+                if (((bits >> i) & 1) && p < follow.size())
+                {
+                    result |= follow[p];
+                }
+            }
+
+            m_chunks[chunk][bits] = result;
+        }
+    }
+}
+
+} // namespace fsm
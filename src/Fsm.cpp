@@ -2,48 +2,53 @@
 #include <algorithm>
 #include <cstddef>
 #include <stdexcept>
+#include <unordered_set>
 
 namespace fsm {
 
 Fsm::Fsm(
     std::size_t states,
-    const std::set<state_t> &s,
-    const std::set<state_t> &f)
-    : m_transitions(states)
-    , m_starting_states(s)
-    , m_final_states(f)
+    const state_set_t &s,
+    const state_set_t &f,
+    allocator_type alloc)
+    : m_alphabet(alloc)
+    , m_transitions((checkStateCount(states), states), alloc)
+    , m_starting_states(s, alloc)
+    , m_final_states(f, alloc)
 {
-    for (std::vector<std::set<symbol_t>> &t : m_transitions)
+    for (auto &row : m_transitions)
     {
-        t.resize(states);
+        row.resize(states);
     }
 }
 
 Fsm::Fsm(
     const std::vector<std::vector<std::set<symbol_t>>> &t,
-    const std::set<state_t> &s,
-    const std::set<state_t> &f)
-    : m_transitions(t)
-    , m_starting_states(s)
-    , m_final_states(f)
+    const state_set_t &s,
+    const state_set_t &f,
+    allocator_type alloc)
+    : Fsm(t.size(), s, f, alloc)
 {
+    for (state_t s1 = 0; s1 < t.size(); s1++)
+    {
+        for (state_t s2 = 0; s2 < t.size(); s2++)
+        {
+            m_transitions[s1][s2].insert(t[s1][s2].begin(), t[s1][s2].end());
+        }
+    }
+
     buildAlphabet();
 }
 
 Fsm::Fsm(
     const std::set<symbol_t> &alphabet,
     const std::vector<std::vector<std::vector<state_t>>> &t,
-    const std::set<state_t> &s,
-    const std::set<state_t> &f)
-    : m_alphabet(alphabet)
-    , m_transitions(t.size())
-    , m_starting_states(s)
-    , m_final_states(f)
+    const state_set_t &s,
+    const state_set_t &f,
+    allocator_type alloc)
+    : Fsm(t.size(), s, f, alloc)
 {
-    for (auto &row : m_transitions)
-    {
-        row.resize(t.size());
-    }
+    m_alphabet.insert(alphabet.begin(), alphabet.end());
 
     for (state_t s1 = 0; s1 < t.size(); s1++)
     {
@@ -64,6 +69,19 @@ Fsm::Fsm(
     }
 }
 
+Fsm::Fsm(const Fsm &other, allocator_type alloc)
+    : m_alphabet(other.m_alphabet, alloc)
+    , m_transitions(other.m_transitions, alloc)
+    , m_starting_states(other.m_starting_states, alloc)
+    , m_final_states(other.m_final_states, alloc)
+{
+}
+
+Fsm::allocator_type Fsm::get_allocator() const
+{
+    return m_transitions.get_allocator();
+}
+
 void Fsm::connect(state_t s1, state_t s2, symbol_t a)
 {
     m_transitions[s1][s2].insert(a);
@@ -97,24 +115,28 @@ void Fsm::setFinal(state_t state, bool value)
     }
 }
 
-std::vector<std::vector<std::set<Fsm::symbol_t>>> Fsm::getTransitions() const
+const Fsm::transitions_t &Fsm::getTransitions() const
 {
     return m_transitions;
 }
 
-std::set<Fsm::state_t> Fsm::getStartingStates() const
+const Fsm::state_set_t &Fsm::getStartingStates() const
 {
     return m_starting_states;
 }
 
-std::set<Fsm::state_t> Fsm::getFinalStates() const
+const Fsm::state_set_t &Fsm::getFinalStates() const
 {
     return m_final_states;
 }
 
 Fsm Fsm::rev() const
 {
-    Fsm rfsm(m_transitions.size(), m_final_states, m_starting_states);
+    Fsm rfsm(
+        m_transitions.size(),
+        m_final_states,
+        m_starting_states,
+        get_allocator());
 
     for (state_t s1 = 0; s1 < m_transitions.size(); s1++)
     {
@@ -132,11 +154,42 @@ Fsm Fsm::rev() const
 
 Fsm Fsm::det() const
 {
-    const std::vector<std::set<state_t>> &closures = epsilonClosures();
+    std::pmr::vector<state_set_t> subsets(get_allocator());
+    return det(subsets);
+}
+
+Fsm Fsm::det(std::pmr::vector<state_set_t> &q) const
+{
+    std::pmr::vector<std::pmr::vector<state_t>> rows(get_allocator());
+    buildSubsets(q, rows, npos);
+
+    return fromSubsets(q, rows);
+}
 
-    std::vector<std::set<state_t>> q;
+std::unique_ptr<Fsm> Fsm::detBounded(std::size_t max_states) const
+{
+    std::pmr::vector<state_set_t> q(get_allocator());
+    std::pmr::vector<std::pmr::vector<state_t>> rows(get_allocator());
 
-    std::set<state_t> q0;
+    if (!buildSubsets(q, rows, max_states))
+    {
+        return nullptr;
+    }
+
+    return std::make_unique<Fsm>(fromSubsets(q, rows));
+}
+
+bool Fsm::buildSubsets(
+    std::pmr::vector<state_set_t> &q,
+    std::pmr::vector<std::pmr::vector<state_t>> &rows,
+    std::size_t max_states) const
+{
+    const edges_t &edges = buildEdges();
+    const std::pmr::vector<state_set_t> &closures = epsilonClosures(edges);
+
+    q.clear();
+
+    state_set_t q0(get_allocator());
 
     for (state_t s : m_starting_states)
     {
@@ -145,57 +198,59 @@ Fsm Fsm::det() const
 
     q.push_back(q0);
 
-    std::vector<std::vector<std::vector<state_t>>> t;
+    // Indices into q, hashed and compared by the subsets they stand for, so
+    // that a candidate is looked up by appending it to q
+    auto hash = [&q](std::size_t i) { return SubsetHash()(q[i]); };
+    auto equal = [&q](std::size_t i, std::size_t j) { return q[i] == q[j]; };
+
+    std::pmr::unordered_set<std::size_t, decltype(hash), decltype(equal)> ids(
+        0, hash, equal, get_allocator());
+    ids.insert(0);
 
-    while (t.size() < q.size())
+    rows.clear();
+
+    while (rows.size() < q.size())
     {
-        std::vector<std::vector<state_t>> row;
+        if (q.size() > max_states)
+        {
+            return false;
+        }
+
+        std::pmr::vector<state_t> row(get_allocator());
 
         for (symbol_t a : m_alphabet)
         {
-            std::set<state_t> ts;
-
-            for (state_t i : q[t.size()])
-            {
-                for (state_t s = 0; s < m_transitions.size(); s++)
-                {
-                    if (m_transitions[i][s].find(a) !=
-                        m_transitions[i][s].end())
-                    {
-                        ts.insert(closures[s].begin(), closures[s].end());
-                    }
-                }
-            }
+            state_set_t ts = successors(q[rows.size()], a, closures, edges);
 
             if (ts.empty())
             {
-                row.push_back({});
+                row.push_back(npos);
                 continue;
             }
 
-            state_t index;
+            q.push_back(std::move(ts));
 
-            const auto &it = std::find(q.begin(), q.end(), ts);
+            auto inserted = ids.insert(q.size() - 1);
 
-            if (it == q.end())
-            {
-                index = q.size();
-                q.push_back(ts);
-            }
-            else
+            if (!inserted.second)
             {
-                index = it - q.begin();
+                q.pop_back();
             }
 
-            row.push_back({index});
+            row.push_back(*inserted.first);
         }
 
-        row.push_back({});
-
-        t.push_back(row);
+        rows.push_back(std::move(row));
     }
 
-    std::set<state_t> f;
+    return q.size() <= max_states;
+}
+
+Fsm Fsm::fromSubsets(
+    const std::pmr::vector<state_set_t> &q,
+    const std::pmr::vector<std::pmr::vector<state_t>> &rows) const
+{
+    state_set_t f(get_allocator());
 
     for (std::size_t i = 0; i < q.size(); i++)
     {
@@ -208,7 +263,7 @@ Fsm Fsm::det() const
         }
     }
 
-    return Fsm(m_alphabet, t, {0}, f);
+    return fromRows(rows, f);
 }
 
 Fsm Fsm::min() const
@@ -216,6 +271,41 @@ Fsm Fsm::min() const
     return rev().det().rev().det();
 }
 
+std::unique_ptr<Fsm> Fsm::min(std::size_t max_states) const
+{
+    std::unique_ptr<Fsm> fsm = rev().detBounded(max_states);
+
+    if (!fsm)
+    {
+        return nullptr;
+    }
+
+    return fsm->rev().detBounded(max_states);
+}
+
+Fsm Fsm::simplify(unsigned passes) const
+{
+    Fsm fsm(*this, get_allocator());
+
+    if (passes & RemoveEpsilons)
+    {
+        fsm = fsm.removeEpsilons();
+    }
+
+    if (passes & Trim)
+    {
+        fsm = fsm.trim();
+    }
+
+    if (passes & MergeStates)
+    {
+        fsm = fsm.quotient(fsm.bisimulation(false));
+        fsm = fsm.quotient(fsm.bisimulation(true));
+    }
+
+    return fsm;
+}
+
 std::ostream &operator<<(std::ostream &stream, const Fsm &fsm)
 {
     for (Fsm::state_t s1 = 0; s1 < fsm.m_transitions.size(); s1++)
@@ -246,21 +336,22 @@ std::ostream &operator<<(std::ostream &stream, const Fsm &fsm)
 }
 
 ///@todo Remove unnecessary epsilon transitions
-Fsm Fsm::concatenation(const std::vector<Fsm> &fsms)
+Fsm Fsm::concatenation(const std::vector<Fsm> &fsms, allocator_type alloc)
 {
     std::size_t states_num = 2;
 
-    std::set<symbol_t> alphabet;
-
     for (const auto &fsm : fsms)
     {
         fsm.ensureAtomic();
         states_num += fsm.getTransitions().size();
-        alphabet.insert(fsm.m_alphabet.begin(), fsm.m_alphabet.end());
     }
 
-    Fsm res(states_num);
-    res.m_alphabet = alphabet;
+    Fsm res(states_num, {}, {}, alloc);
+
+    for (const auto &fsm : fsms)
+    {
+        res.m_alphabet.insert(fsm.m_alphabet.begin(), fsm.m_alphabet.end());
+    }
 
     std::size_t global_index = 1;
 
@@ -274,7 +365,7 @@ Fsm Fsm::concatenation(const std::vector<Fsm> &fsms)
 
     for (const auto &fsm : fsms)
     {
-        auto transitions = fsm.getTransitions();
+        const auto &transitions = fsm.getTransitions();
 
         for (state_t i = 0; i < transitions.size(); i++)
         {
@@ -300,21 +391,22 @@ Fsm Fsm::concatenation(const std::vector<Fsm> &fsms)
 }
 
 ///@todo Boilerplate
-Fsm Fsm::disjunction(const std::vector<Fsm> &fsms)
+Fsm Fsm::disjunction(const std::vector<Fsm> &fsms, allocator_type alloc)
 {
     std::size_t states_num = 2;
 
-    std::set<symbol_t> alphabet;
-
     for (const auto &fsm : fsms)
     {
         fsm.ensureAtomic();
         states_num += fsm.getTransitions().size();
-        alphabet.insert(fsm.m_alphabet.begin(), fsm.m_alphabet.end());
     }
 
-    Fsm res(states_num);
-    res.m_alphabet = alphabet;
+    Fsm res(states_num, {}, {}, alloc);
+
+    for (const auto &fsm : fsms)
+    {
+        res.m_alphabet.insert(fsm.m_alphabet.begin(), fsm.m_alphabet.end());
+    }
 
     std::size_t global_index = 1;
 
@@ -326,7 +418,7 @@ Fsm Fsm::disjunction(const std::vector<Fsm> &fsms)
 
     for (const auto &fsm : fsms)
     {
-        auto transitions = fsm.getTransitions();
+        const auto &transitions = fsm.getTransitions();
 
         for (state_t i = 0; i < transitions.size(); i++)
         {
@@ -356,7 +448,7 @@ Fsm Fsm::option(const Fsm &fsm)
     state_t start = *fsm.getStartingStates().begin();
     state_t end = *fsm.getFinalStates().begin();
 
-    Fsm res = fsm;
+    Fsm res(fsm, fsm.get_allocator());
 
     res.connect(start, end, '\0');
 
@@ -370,13 +462,100 @@ Fsm Fsm::iteration(const Fsm &fsm)
     state_t start = *fsm.getStartingStates().begin();
     state_t end = *fsm.getFinalStates().begin();
 
-    Fsm res = fsm;
+    Fsm res(fsm, fsm.get_allocator());
 
     res.connect(end, start, '\0');
 
     return res;
 }
 
+Fsm::state_set_t Fsm::successors(
+    const state_set_t &subset,
+    symbol_t a,
+    const std::pmr::vector<state_set_t> &closures,
+    const edges_t &edges) const
+{
+    state_set_t ts(subset.get_allocator());
+
+    for (state_t i : subset)
+    {
+        auto it = std::lower_bound(
+            edges[i].begin(), edges[i].end(), std::make_pair(a, state_t{0}));
+
+        for (; it != edges[i].end() && it->first == a; ++it)
+        {
+            ts.insert(closures[it->second].begin(), closures[it->second].end());
+        }
+    }
+
+    return ts;
+}
+
+Fsm Fsm::fromRows(
+    const std::pmr::vector<std::pmr::vector<state_t>> &rows,
+    const state_set_t &f) const
+{
+    Fsm res(rows.size(), {}, f, get_allocator());
+    res.setStarting(0);
+    res.m_alphabet = m_alphabet;
+
+    for (state_t s = 0; s < rows.size(); s++)
+    {
+        auto it = m_alphabet.begin();
+
+        for (state_t next : rows[s])
+        {
+            if (next != npos)
+            {
+                res.m_transitions[s][next].insert(*it);
+            }
+
+            ++it;
+        }
+    }
+
+    return res;
+}
+
+void Fsm::checkStateCount(std::size_t states)
+{
+    if (states >= npos)
+    {
+        throw std::runtime_error("Too many states for FSM_STATE_BITS");
+    }
+}
+
+Fsm::edges_t Fsm::buildEdges(bool backward) const
+{
+    edges_t edges(m_transitions.size(), get_allocator());
+
+    for (state_t s1 = 0; s1 < m_transitions.size(); s1++)
+    {
+        for (state_t s2 = 0; s2 < m_transitions.size(); s2++)
+        {
+            for (symbol_t a : m_transitions[s1][s2])
+            {
+                if (backward)
+                {
+                    edges[s2].emplace_back(a, s1);
+                }
+                else
+                {
+                    edges[s1].emplace_back(a, s2);
+                }
+            }
+        }
+    }
+
+    // The edges of a symbol are then found by binary search
+    for (auto &list : edges)
+    {
+        std::sort(list.begin(), list.end());
+    }
+
+    return edges;
+}
+
 void Fsm::buildAlphabet()
 {
     m_alphabet.clear();
@@ -419,44 +598,239 @@ void Fsm::printState(std::ostream &stream, state_t state) const
     }
 }
 
-std::vector<std::set<Fsm::state_t>> Fsm::epsilonClosures() const
+std::pmr::vector<Fsm::state_set_t> Fsm::epsilonClosures(
+    const edges_t &edges) const
 {
-    std::vector<std::set<state_t>> closures(m_transitions.size());
-    std::vector<bool> flags(m_transitions.size(), false);
-
-    for (state_t s = 0; s < m_transitions.size(); s++)
-    {
-        closures[s].insert(s);
-    }
+    std::pmr::vector<state_set_t> closures(
+        m_transitions.size(), get_allocator());
 
     for (state_t s = 0; s < m_transitions.size(); s++)
     {
-        buildEpsilonClosures(s, closures, flags);
+        buildEpsilonClosure(s, closures[s], edges);
     }
 
     return closures;
 }
 
-void Fsm::buildEpsilonClosures(
+void Fsm::buildEpsilonClosure(
     state_t state,
-    std::vector<std::set<state_t>> &closures,
-    std::vector<bool> &flags) const
+    state_set_t &closure,
+    const edges_t &edges) const
 {
-    if (flags[state])
+    if (!closure.insert(state).second)
     {
         return;
     }
 
-    flags[state] = true;
+    auto it = std::lower_bound(
+        edges[state].begin(),
+        edges[state].end(),
+        std::make_pair('\0', state_t{0}));
+
+    for (; it != edges[state].end() && it->first == '\0'; ++it)
+    {
+        buildEpsilonClosure(it->second, closure, edges);
+    }
+}
+
+Fsm Fsm::removeEpsilons() const
+{
+    const edges_t &edges = buildEdges();
+    const std::pmr::vector<state_set_t> &closures = epsilonClosures(edges);
+
+    Fsm res(m_transitions.size(), m_starting_states, {}, get_allocator());
+
+    for (state_t s1 = 0; s1 < m_transitions.size(); s1++)
+    {
+        for (state_t q : closures[s1])
+        {
+            if (m_final_states.find(q) != m_final_states.end())
+            {
+                res.setFinal(s1);
+            }
+
+            for (const auto &edge : edges[q])
+            {
+                if (edge.first != '\0')
+                {
+                    res.connect(s1, edge.second, edge.first);
+                }
+            }
+        }
+    }
+
+    return res;
+}
+
+Fsm Fsm::trim() const
+{
+    auto mark = [this](const state_set_t &from, bool backward) {
+        std::pmr::vector<bool> marked(
+            m_transitions.size(), false, get_allocator());
+        std::pmr::vector<state_t> stack(
+            from.begin(), from.end(), get_allocator());
+
+        for (state_t s : from)
+        {
+            marked[s] = true;
+        }
+
+        while (!stack.empty())
+        {
+            state_t s1 = stack.back();
+            stack.pop_back();
+
+            for (state_t s2 = 0; s2 < m_transitions.size(); s2++)
+            {
+                const auto &symbols =
+                    backward ? m_transitions[s2][s1] : m_transitions[s1][s2];
+
+                if (!marked[s2] && !symbols.empty())
+                {
+                    marked[s2] = true;
+                    stack.push_back(s2);
+                }
+            }
+        }
+
+        return marked;
+    };
+
+    const std::pmr::vector<bool> &reachable = mark(m_starting_states, false);
+    const std::pmr::vector<bool> &alive = mark(m_final_states, true);
+
+    std::pmr::vector<state_t> blocks(
+        m_transitions.size(), npos, get_allocator());
+    std::size_t count = 0;
+
+    for (state_t s = 0; s < m_transitions.size(); s++)
+    {
+        if (reachable[s] && alive[s])
+        {
+            blocks[s] = count++;
+        }
+    }
+
+    return quotient(blocks);
+}
+
+std::pmr::vector<Fsm::state_t> Fsm::bisimulation(bool backward) const
+{
+    // Partition refinement, starting from final (starting) states and
+    // splitting blocks by the labels and blocks of outgoing (incoming) edges
+    const state_set_t &initial =
+        backward ? m_starting_states : m_final_states;
+
+    const edges_t &edges = buildEdges(backward);
+
+    std::pmr::vector<state_t> blocks(m_transitions.size(), get_allocator());
+    std::size_t count = 0;
 
     for (state_t s = 0; s < m_transitions.size(); s++)
     {
-        if (m_transitions[state][s].find('\0') != m_transitions[state][s].end())
+        blocks[s] = initial.find(s) != initial.end() ? 1 : 0;
+    }
+
+    while (true)
+    {
+        using signature_t = std::pmr::set<std::pair<symbol_t, state_t>>;
+
+        std::pmr::map<std::pair<state_t, signature_t>, state_t> ids(
+            get_allocator());
+        std::pmr::vector<state_t> refined(
+            m_transitions.size(), get_allocator());
+
+        for (state_t s1 = 0; s1 < m_transitions.size(); s1++)
+        {
+            signature_t signature(get_allocator());
+
+            for (const auto &edge : edges[s1])
+            {
+                signature.emplace(edge.first, blocks[edge.second]);
+            }
+
+            auto key = std::make_pair(blocks[s1], std::move(signature));
+            refined[s1] =
+                ids.emplace(std::move(key), ids.size()).first->second;
+        }
+
+        blocks.swap(refined);
+
+        if (ids.size() == count)
         {
-            buildEpsilonClosures(s, closures, flags);
-            closures[state].insert(closures[s].begin(), closures[s].end());
+            break;
         }
+
+        count = ids.size();
     }
+
+    return blocks;
+}
+
+Fsm Fsm::quotient(const std::pmr::vector<state_t> &blocks) const
+{
+    std::size_t states = 0;
+
+    for (state_t b : blocks)
+    {
+        if (b != npos && std::size_t{b} + 1 > states)
+        {
+            states = std::size_t{b} + 1;
+        }
+    }
+
+    Fsm res(states, {}, {}, get_allocator());
+
+    for (state_t s1 = 0; s1 < m_transitions.size(); s1++)
+    {
+        if (blocks[s1] == npos)
+        {
+            continue;
+        }
+
+        for (state_t s2 = 0; s2 < m_transitions.size(); s2++)
+        {
+            if (blocks[s2] == npos)
+            {
+                continue;
+            }
+
+            for (symbol_t a : m_transitions[s1][s2])
+            {
+                res.connect(blocks[s1], blocks[s2], a);
+            }
+        }
+    }
+
+    for (state_t s : m_starting_states)
+    {
+        if (blocks[s] != npos)
+        {
+            res.setStarting(blocks[s]);
+        }
+    }
+
+    for (state_t s : m_final_states)
+    {
+        if (blocks[s] != npos)
+        {
+            res.setFinal(blocks[s]);
+        }
+    }
+
+    return res;
+}
+
+std::size_t SubsetHash::operator()(const Fsm::state_set_t &subset) const
+{
+    std::size_t hash = subset.size();
+
+    for (Fsm::state_t s : subset)
+    {
+        hash ^= s + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+    }
+
+    return hash;
 }
 
 ///@todo Refactor this
@@ -0,0 +1,334 @@
+#include "fsm/Fsm.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+
+namespace fsm {
+
+/// Concurrent map from subsets to provisional state ids, split into
+/// independently locked shards
+class SubsetTable final
+{
+public: // methods
+    explicit SubsetTable(std::size_t shards)
+        : m_shards(shards)
+        , m_next{0}
+    {
+    }
+
+    /// Returns the id of the subset, along with the stored subset if this
+    /// call inserted it and null otherwise
+    std::pair<std::size_t, const Fsm::state_set_t *> intern(
+        Fsm::state_set_t &&subset)
+    {
+        Shard &shard = m_shards[SubsetHash()(subset) % m_shards.size()];
+
+        std::lock_guard<std::mutex> lock(shard.mutex);
+
+        auto it = shard.ids.find(subset);
+
+        if (it != shard.ids.end())
+        {
+            return {it->second, nullptr};
+        }
+
+        it = shard.ids.emplace(std::move(subset), m_next++).first;
+        return {it->second, &it->first};
+    }
+
+    std::size_t size() const
+    {
+        return m_next;
+    }
+
+private: // types
+    struct Shard
+    {
+        std::mutex mutex;
+        std::unordered_map<Fsm::state_set_t, std::size_t, SubsetHash>
+            ids;
+    };
+
+private: // fields
+    std::vector<Shard> m_shards;
+    std::atomic<std::size_t> m_next;
+};
+
+struct SubsetTask
+{
+    std::size_t id;
+    const Fsm::state_set_t *subset;
+};
+
+/// Deque of one worker: the owner pushes and pops at the back, other
+/// workers steal from the front
+class WorkDeque final
+{
+public: // methods
+    void push(const SubsetTask &task)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_tasks.push_back(task);
+    }
+
+    bool pop(SubsetTask &task)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (m_tasks.empty())
+        {
+            return false;
+        }
+
+        task = m_tasks.back();
+        m_tasks.pop_back();
+        return true;
+    }
+
+    bool steal(SubsetTask &task)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (m_tasks.empty())
+        {
+            return false;
+        }
+
+        task = m_tasks.front();
+        m_tasks.pop_front();
+        return true;
+    }
+
+private: // fields
+    std::mutex m_mutex;
+    std::deque<SubsetTask> m_tasks;
+};
+
+static constexpr std::size_t NoSubset = static_cast<std::size_t>(-1);
+
+/// DFAs up to this size are built sequentially, as the threads would cost
+/// more than they save
+static const std::size_t MinParallelStates = 128;
+
+struct SubsetRow
+{
+    std::size_t id;
+    bool final;
+    std::vector<std::size_t> next;
+};
+
+Fsm Fsm::detParallel(std::size_t threads) const
+{
+    if (threads == 0)
+    {
+        threads = std::thread::hardware_concurrency();
+    }
+
+    if (threads == 0)
+    {
+        threads = 1;
+    }
+
+    if (threads == 1)
+    {
+        return det();
+    }
+
+    if (std::unique_ptr<Fsm> dfa = detBounded(MinParallelStates))
+    {
+        return std::move(*dfa);
+    }
+
+    const edges_t &edges = buildEdges();
+    const std::pmr::vector<state_set_t> &closures = epsilonClosures(edges);
+
+    // The resource of this FSM need not be thread-safe, so subsets shared
+    // between workers come from the global heap
+    state_set_t q0(std::pmr::new_delete_resource());
+
+    for (state_t s : m_starting_states)
+    {
+        q0.insert(closures[s].begin(), closures[s].end());
+    }
+
+    SubsetTable table(threads * 16);
+    std::vector<WorkDeque> queues(threads);
+    std::vector<std::vector<SubsetRow>> results(threads);
+    std::atomic<std::size_t> pending{1};
+
+    // Workers without a task sleep until one is queued or all are done.
+    // Queuing bumps queued before looking for sleepers and a worker counts
+    // itself as sleeping before looking at queued, so one of them sees the
+    // other and no wakeup is lost. A task is counted before it is pushed,
+    // so a worker woken early just looks again.
+    std::mutex idle_mutex;
+    std::condition_variable idle;
+    std::atomic<std::size_t> queued{1};
+    std::atomic<std::size_t> sleeping{0};
+
+    auto wake = [&](bool all) {
+        if (sleeping > 0)
+        {
+            {
+                std::lock_guard<std::mutex> lock(idle_mutex);
+            }
+
+            if (all)
+            {
+                idle.notify_all();
+            }
+            else
+            {
+                idle.notify_one();
+            }
+        }
+    };
+
+    auto start = table.intern(std::move(q0));
+    queues[0].push(SubsetTask{start.first, start.second});
+
+    auto work = [&](std::size_t self) {
+        SubsetTask task;
+
+        while (true)
+        {
+            bool found = queues[self].pop(task);
+
+            for (std::size_t k = 1; !found && k < threads; k++)
+            {
+                found = queues[(self + k) % threads].steal(task);
+            }
+
+            if (!found)
+            {
+                std::unique_lock<std::mutex> lock(idle_mutex);
+
+                sleeping++;
+                idle.wait(lock, [&]() { return queued > 0 || pending == 0; });
+                sleeping--;
+
+                if (pending == 0)
+                {
+                    return;
+                }
+
+                continue;
+            }
+
+            queued--;
+
+            SubsetRow row{task.id, false, {}};
+
+            for (state_t s : *task.subset)
+            {
+                if (m_final_states.find(s) != m_final_states.end())
+                {
+                    row.final = true;
+                    break;
+                }
+            }
+
+            for (symbol_t a : m_alphabet)
+            {
+                state_set_t ts = successors(*task.subset, a, closures, edges);
+
+                if (ts.empty())
+                {
+                    row.next.push_back(NoSubset);
+                    continue;
+                }
+
+                auto result = table.intern(std::move(ts));
+
+                if (result.second)
+                {
+                    pending++;
+                    queued++;
+                    queues[self].push(SubsetTask{result.first, result.second});
+                    wake(false);
+                }
+
+                row.next.push_back(result.first);
+            }
+
+            results[self].push_back(std::move(row));
+
+            if (--pending == 0)
+            {
+                wake(true);
+            }
+        }
+    };
+
+    std::vector<std::thread> workers;
+
+    for (std::size_t i = 1; i < threads; i++)
+    {
+        workers.emplace_back(work, i);
+    }
+
+    work(0);
+
+    for (std::thread &worker : workers)
+    {
+        worker.join();
+    }
+
+    std::vector<const SubsetRow *> rows(table.size());
+
+    for (const auto &result : results)
+    {
+        for (const SubsetRow &row : result)
+        {
+            rows[row.id] = &row;
+        }
+    }
+
+    // Provisional ids depend on thread timing. Numbering states breadth
+    // first in alphabet order gives the same numbering as det().
+    std::vector<state_t> index(rows.size(), npos);
+    std::vector<std::size_t> order{start.first};
+    index[start.first] = 0;
+
+    std::pmr::vector<std::pmr::vector<state_t>> t(get_allocator());
+    state_set_t f(get_allocator());
+
+    for (std::size_t i = 0; i < order.size(); i++)
+    {
+        const SubsetRow &row = *rows[order[i]];
+
+        std::pmr::vector<state_t> next(get_allocator());
+
+        for (std::size_t id : row.next)
+        {
+            if (id == NoSubset)
+            {
+                next.push_back(npos);
+                continue;
+            }
+
+            if (index[id] == npos)
+            {
+                index[id] = order.size();
+                order.push_back(id);
+            }
+
+            next.push_back(index[id]);
+        }
+
+        t.push_back(std::move(next));
+
+        if (row.final)
+        {
+            f.insert(i);
+        }
+    }
+
+    return fromRows(t, f);
+}
+
+} // namespace fsm
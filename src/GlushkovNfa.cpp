@@ -0,0 +1,144 @@
+#include "fsm/GlushkovNfa.hpp"
+#include <stdexcept>
+
+namespace fsm {
+
+GlushkovNfa::Builder::Builder()
+    : m_follow(1, 0)
+    , m_overflow{false}
+{
+    m_symbols.emplace_back();
+}
+
+GlushkovNfa::mask_t GlushkovNfa::Builder::addPosition(
+    const std::bitset<256> &symbols)
+{
+    if (m_symbols.size() > MaxPositions)
+    {
+        m_overflow = true;
+        return 0;
+    }
+
+    m_symbols.push_back(symbols);
+    m_follow.push_back(0);
+
+    return mask_t{1} << (m_symbols.size() - 1);
+}
+
+void GlushkovNfa::Builder::addFollow(mask_t from, mask_t to)
+{
+    for (std::size_t p = 0; p < m_follow.size(); p++)
+    {
+        if ((from >> p) & 1)
+        {
+            m_follow[p] |= to;
+        }
+    }
+}
+
+bool GlushkovNfa::Builder::overflow() const
+{
+    return m_overflow;
+}
+
+std::size_t GlushkovNfa::Builder::getPositionCount() const
+{
+    return m_symbols.size() - 1;
+}
+
+GlushkovNfa GlushkovNfa::Builder::build(
+    mask_t first,
+    mask_t last,
+    bool nullable,
+    const ByteFold &fold) const
+{
+    if (m_overflow)
+    {
+        throw std::runtime_error("pattern has too many positions");
+    }
+
+    std::vector<mask_t> follow = m_follow;
+    follow[0] = first;
+
+    return GlushkovNfa(m_symbols, follow, nullable ? last | 1 : last, fold);
+}
+
+GlushkovNfa::GlushkovNfa(
+    const std::vector<std::bitset<256>> &symbols,
+    const std::vector<mask_t> &follow,
+    mask_t final,
+    const ByteFold &fold)
+    : m_follow(follow)
+    , m_final{final}
+{
+    m_symbols.fill(0);
+
+    for (std::size_t p = 0; p < symbols.size(); p++)
+    {
+        for (std::size_t byte = 0; byte < 256; byte++)
+        {
+            if (symbols[p][fold[byte]])
+            {
+                m_symbols[byte] |= mask_t{1} << p;
+            }
+        }
+    }
+}
+
+bool GlushkovNfa::match(const char *data, std::size_t size) const
+{
+    mask_t states = 1;
+
+    for (std::size_t i = 0; i < size && states; i++)
+    {
+        states = m_follow.follow(states) &
+                 m_symbols[static_cast<unsigned char>(data[i])];
+    }
+
+    return (states & m_final) != 0;
+}
+
+bool GlushkovNfa::search(const char *data, std::size_t size) const
+{
+    if (m_final & 1)
+    {
+        return true;
+    }
+
+    mask_t states = 0;
+
+    for (std::size_t i = 0; i < size; i++)
+    {
+        // Re-entering the initial state starts a match at every position
+        states = m_follow.follow(states | 1) &
+                 m_symbols[static_cast<unsigned char>(data[i])];
+
+        if (states & m_final)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+std::size_t GlushkovNfa::matchLongest(const char *data, std::size_t size) const
+{
+    mask_t states = 1;
+    std::size_t longest = (m_final & 1) ? 0 : npos;
+
+    for (std::size_t i = 0; i < size && states; i++)
+    {
+        states = m_follow.follow(states) &
+                 m_symbols[static_cast<unsigned char>(data[i])];
+
+        if (states & m_final)
+        {
+            longest = i + 1;
+        }
+    }
+
+    return longest;
+}
+
+} // namespace fsm
@@ -0,0 +1,203 @@
+#include "fsm/Lexer.hpp"
+#include <map>
+#include <memory_resource>
+#include "fsm/ByteClasses.hpp"
+#include "fsm/Fsm.hpp"
+#include "fsm/Regex.hpp"
+
+namespace fsm {
+
+Lexer::Lexer(const std::vector<Rule> &rules)
+{
+    // Rule automata, their union and its DFA are dropped once the table is
+    // filled, so they are all allocated from the arena
+    std::pmr::monotonic_buffer_resource arena;
+
+    // Union of the rule automata, remembering which rule every final state
+    // belongs to
+    std::vector<Fsm> fsms;
+    std::size_t states = 1;
+
+    for (const Rule &rule : rules)
+    {
+        fsms.emplace_back(Regex::buildFsm(rule.pattern, &arena));
+        states += fsms.back().getTransitions().size();
+    }
+
+    Fsm nfa(states, {}, {}, &arena);
+    nfa.setStarting(0);
+
+    std::vector<int> rule_of(states, -1);
+    std::size_t offset = 1;
+
+    for (std::size_t i = 0; i < fsms.size(); i++)
+    {
+        const auto &transitions = fsms[i].getTransitions();
+
+        for (Fsm::state_t s1 = 0; s1 < transitions.size(); s1++)
+        {
+            for (Fsm::state_t s2 = 0; s2 < transitions.size(); s2++)
+            {
+                for (Fsm::symbol_t a : transitions[s1][s2])
+                {
+                    nfa.connect(offset + s1, offset + s2, a);
+                }
+            }
+        }
+
+        for (Fsm::state_t s : fsms[i].getStartingStates())
+        {
+            nfa.connect(0, offset + s, '\0');
+        }
+
+        for (Fsm::state_t s : fsms[i].getFinalStates())
+        {
+            nfa.setFinal(offset + s);
+            rule_of[offset + s] = static_cast<int>(i);
+        }
+
+        offset += transitions.size();
+    }
+
+    std::pmr::vector<Fsm::state_set_t> subsets(&arena);
+    Fsm dfa = nfa.det(subsets);
+
+    const std::size_t dfa_states = dfa.getTransitions().size();
+    const state_t dead = dfa_states;
+
+    std::vector<int> tokens(dfa_states + 1, Error);
+
+    for (state_t s = 0; s < dfa_states; s++)
+    {
+        int best = -1;
+
+        for (Fsm::state_t q : subsets[s])
+        {
+            int rule = rule_of[q];
+
+            if (rule >= 0 &&
+                (best < 0 || rules[rule].priority > rules[best].priority))
+            {
+                best = rule;
+            }
+        }
+
+        if (best >= 0)
+        {
+            tokens[s] = rules[best].token;
+        }
+    }
+
+    ByteClasses classes(dfa);
+
+    m_classes = classes.getClasses();
+    m_class_count = classes.getClassCount();
+
+    // Moore's partition refinement, starting from the states grouped by
+    // token, so that minimization never merges states of different tokens
+    std::vector<std::size_t> blocks(dfa_states + 1);
+    std::size_t block_count = 0;
+
+    {
+        std::map<int, std::size_t> ids;
+
+        for (state_t s = 0; s <= dfa_states; s++)
+        {
+            blocks[s] = ids.emplace(tokens[s], ids.size()).first->second;
+        }
+
+        block_count = ids.size();
+    }
+
+    while (true)
+    {
+        std::map<std::vector<std::size_t>, std::size_t> ids;
+        std::vector<std::size_t> refined(dfa_states + 1);
+
+        for (state_t s = 0; s <= dfa_states; s++)
+        {
+            std::vector<std::size_t> signature{blocks[s]};
+
+            for (std::size_t c = 0; c < m_class_count; c++)
+            {
+                signature.push_back(blocks[classes.next(s, c)]);
+            }
+
+            refined[s] = ids.emplace(signature, ids.size()).first->second;
+        }
+
+        blocks.swap(refined);
+
+        if (ids.size() == block_count)
+        {
+            break;
+        }
+
+        block_count = ids.size();
+    }
+
+    m_table.resize(block_count * m_class_count);
+    m_tokens.resize(block_count);
+
+    for (state_t s = 0; s <= dfa_states; s++)
+    {
+        for (std::size_t c = 0; c < m_class_count; c++)
+        {
+            m_table[blocks[s] * m_class_count + c] =
+                blocks[classes.next(s, c)];
+        }
+
+        m_tokens[blocks[s]] = tokens[s];
+    }
+
+    m_start = blocks[*dfa.getStartingStates().begin()];
+    m_dead = blocks[dead];
+}
+
+bool Lexer::next(const char *&pos, const char *end, Token &token) const
+{
+    if (pos >= end)
+    {
+        return false;
+    }
+
+    state_t state = m_start;
+    const char *last = nullptr;
+    int id = Error;
+
+    for (const char *p = pos; p < end; p++)
+    {
+        state = m_table
+            [state * m_class_count + m_classes[static_cast<unsigned char>(*p)]];
+
+        if (state == m_dead)
+        {
+            break;
+        }
+
+        if (m_tokens[state] != Error)
+        {
+            last = p + 1;
+            id = m_tokens[state];
+        }
+    }
+
+    if (!last)
+    {
+        token = Token{Error, pos, 1};
+        pos++;
+        return true;
+    }
+
+    token = Token{id, pos, static_cast<std::size_t>(last - pos)};
+    pos = last;
+
+    return true;
+}
+
+std::size_t Lexer::getStateCount() const
+{
+    return m_tokens.size();
+}
+
+} // namespace fsm
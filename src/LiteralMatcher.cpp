@@ -0,0 +1,247 @@
+#include "fsm/LiteralMatcher.hpp"
+#include <algorithm>
+#include <bitset>
+#include <cstring>
+#include <stdexcept>
+#include <string_view>
+#include "fsm/ByteClasses.hpp"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace fsm {
+
+LiteralMatcher::LiteralMatcher(const std::vector<std::string> &literals)
+    : m_literals(literals)
+{
+    if (!fits(literals))
+    {
+        throw std::runtime_error("too many literals");
+    }
+
+    std::sort(m_literals.begin(), m_literals.end());
+    m_literals.erase(
+        std::unique(m_literals.begin(), m_literals.end()), m_literals.end());
+
+    if (m_literals.size() > 1)
+    {
+        buildAutomaton();
+    }
+}
+
+bool LiteralMatcher::fits(const std::vector<std::string> &literals)
+{
+    if (literals.empty() || literals.size() > MaxLiterals)
+    {
+        return false;
+    }
+
+    std::size_t states = 1;
+
+    for (const std::string &literal : literals)
+    {
+        states += literal.size();
+    }
+
+    return states <= MaxStates;
+}
+
+bool LiteralMatcher::match(const char *data, std::size_t size) const
+{
+    if (m_literals.size() == 1)
+    {
+        return m_literals[0].size() == size &&
+               std::memcmp(m_literals[0].data(), data, size) == 0;
+    }
+
+    return std::binary_search(
+        m_literals.begin(),
+        m_literals.end(),
+        std::string_view(data, size),
+        [](std::string_view a, std::string_view b) { return a < b; });
+}
+
+bool LiteralMatcher::search(const char *data, std::size_t size) const
+{
+    if (m_literals.size() == 1)
+    {
+        return searchLiteral(data, size);
+    }
+
+    return searchSet(data, size);
+}
+
+bool LiteralMatcher::searchLiteral(const char *data, std::size_t size) const
+{
+    const std::string &literal = m_literals[0];
+    const std::size_t n = literal.size();
+
+    if (n == 0)
+    {
+        return true;
+    }
+
+    if (size < n)
+    {
+        return false;
+    }
+
+    if (n == 1)
+    {
+        return std::memchr(data, literal[0], size) != nullptr;
+    }
+
+    std::size_t i = 0;
+
+#ifdef __SSE2__
+    const __m128i first = _mm_set1_epi8(literal[0]);
+    const __m128i last = _mm_set1_epi8(literal[n - 1]);
+
+    for (; i + n - 1 + 16 <= size; i += 16)
+    {
+        const __m128i a =
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+        const __m128i b = _mm_loadu_si128(
+            reinterpret_cast<const __m128i *>(data + i + n - 1));
+
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last))));
+
+        while (mask)
+        {
+            std::size_t candidate = i + __builtin_ctz(mask);
+
+            if (std::memcmp(data + candidate + 1, literal.data() + 1, n - 2) ==
+                0)
+            {
+                return true;
+            }
+
+            mask &= mask - 1;
+        }
+    }
+#endif
+
+    return std::string_view(data + i, size - i).find(literal) !=
+           std::string_view::npos;
+}
+
+bool LiteralMatcher::searchSet(const char *data, std::size_t size) const
+{
+    std::uint32_t state = 0;
+
+    if (m_final[state])
+    {
+        return true;
+    }
+
+    for (std::size_t i = 0; i < size; i++)
+    {
+        state = m_table
+            [state * m_class_count +
+             m_classes[static_cast<unsigned char>(data[i])]];
+
+        if (m_final[state])
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void LiteralMatcher::buildAutomaton()
+{
+    // Every byte of the literals gets a class of its own, and the bytes
+    // that occur in no literal share one
+    std::bitset<256> bytes;
+
+    for (const std::string &literal : m_literals)
+    {
+        for (char c : literal)
+        {
+            bytes.set(static_cast<unsigned char>(c));
+        }
+    }
+
+    m_classes.fill(0);
+    m_class_count = 1;
+
+    for (std::size_t byte = 0; byte < 256; byte++)
+    {
+        if (bytes[byte])
+        {
+            m_class_count = ByteClasses::refine(
+                m_classes, std::bitset<256>().set(byte));
+        }
+    }
+
+    static const std::uint32_t None = static_cast<std::uint32_t>(-1);
+
+    // Trie of the literals
+    std::vector<std::uint32_t> trie(m_class_count, None);
+    m_final.assign(1, false);
+
+    for (const std::string &literal : m_literals)
+    {
+        std::uint32_t state = 0;
+
+        for (char c : literal)
+        {
+            std::size_t index = state * m_class_count +
+                                m_classes[static_cast<unsigned char>(c)];
+
+            if (trie[index] == None)
+            {
+                trie[index] = static_cast<std::uint32_t>(m_final.size());
+                trie.resize(trie.size() + m_class_count, None);
+                m_final.push_back(false);
+            }
+
+            state = trie[index];
+        }
+
+        m_final[state] = true;
+    }
+
+    // Failure links, resolved into a complete transition table breadth
+    // first so that the table of every failure target is already complete
+    m_table.assign(trie.size(), 0);
+
+    std::vector<std::uint32_t> fail(m_final.size(), 0);
+    std::vector<std::uint32_t> queue;
+
+    for (std::size_t c = 0; c < m_class_count; c++)
+    {
+        if (trie[c] != None)
+        {
+            m_table[c] = trie[c];
+            queue.push_back(trie[c]);
+        }
+    }
+
+    for (std::size_t i = 0; i < queue.size(); i++)
+    {
+        std::uint32_t state = queue[i];
+
+        for (std::size_t c = 0; c < m_class_count; c++)
+        {
+            std::uint32_t child = trie[state * m_class_count + c];
+            std::uint32_t next = m_table[fail[state] * m_class_count + c];
+
+            if (child == None)
+            {
+                m_table[state * m_class_count + c] = next;
+                continue;
+            }
+
+            fail[child] = next;
+            m_final[child] = m_final[child] || m_final[next];
+            m_table[state * m_class_count + c] = child;
+            queue.push_back(child);
+        }
+    }
+}
+
+} // namespace fsm
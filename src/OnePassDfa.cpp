@@ -0,0 +1,198 @@
+#include "fsm/OnePassDfa.hpp"
+#include <limits>
+#include <map>
+#include "fsm/ByteClasses.hpp"
+#include "fsm/Program.hpp"
+
+namespace fsm {
+
+static const std::uint32_t NoState = std::numeric_limits<std::uint32_t>::max();
+
+/// Walks the epsilon closure of one state in priority order, collecting the
+/// reachable Consume and Match instructions with the slots saved on the way
+/// there. Fails if an instruction is reachable twice, since the paths could
+/// disagree on the slots.
+static bool collectClosure(
+    const Program &program,
+    std::size_t pc,
+    OnePassDfa::mask_t actions,
+    std::vector<bool> &visited,
+    std::vector<std::pair<std::size_t, OnePassDfa::mask_t>> &result)
+{
+    if (visited[pc])
+    {
+        return false;
+    }
+
+    visited[pc] = true;
+
+    const Program::Instruction &instruction = program[pc];
+
+    switch (instruction.opcode)
+    {
+    case Program::Opcode::Jump:
+        return collectClosure(program, instruction.x, actions, visited, result);
+
+    case Program::Opcode::Split:
+        return collectClosure(
+                   program, instruction.x, actions, visited, result) &&
+               collectClosure(program, instruction.y, actions, visited, result);
+
+    case Program::Opcode::Save:
+        return collectClosure(
+            program,
+            pc + 1,
+            actions | (OnePassDfa::mask_t{1} << instruction.x),
+            visited,
+            result);
+
+    default:
+        result.emplace_back(pc, actions);
+        return true;
+    }
+}
+
+std::unique_ptr<OnePassDfa> OnePassDfa::build(const Program &program)
+{
+    if (program.getSlotCount() > MaxSlots)
+    {
+        return nullptr;
+    }
+
+    std::unique_ptr<OnePassDfa> dfa(new OnePassDfa);
+    dfa->m_slot_count = program.getSlotCount();
+
+    // Bytes accepted by exactly the same Consume instructions are equivalent
+    dfa->m_classes.fill(0);
+    dfa->m_class_count = 1;
+
+    for (std::size_t pc = 0; pc < program.size(); pc++)
+    {
+        if (program[pc].opcode == Program::Opcode::Consume)
+        {
+            dfa->m_class_count =
+                ByteClasses::refine(dfa->m_classes, program[pc].symbols);
+        }
+    }
+
+    std::vector<std::size_t> representatives(dfa->m_class_count);
+
+    for (std::size_t byte = 256; byte-- > 0;)
+    {
+        representatives[dfa->m_classes[byte]] = byte;
+    }
+
+    // States are the start of the program and the instructions following a
+    // Consume, discovered on demand
+    std::map<std::size_t, std::uint32_t> state_ids;
+    std::vector<std::size_t> state_pcs;
+
+    auto getState = [&](std::size_t pc) {
+        auto it = state_ids.find(pc);
+
+        if (it != state_ids.end())
+        {
+            return it->second;
+        }
+
+        std::uint32_t id = static_cast<std::uint32_t>(state_pcs.size());
+        state_ids.emplace(pc, id);
+        state_pcs.push_back(pc);
+        return id;
+    };
+
+    getState(0);
+
+    for (std::size_t state = 0; state < state_pcs.size(); state++)
+    {
+        std::vector<bool> visited(program.size(), false);
+        std::vector<std::pair<std::size_t, mask_t>> closure;
+
+        if (!collectClosure(program, state_pcs[state], 0, visited, closure))
+        {
+            return nullptr;
+        }
+
+        std::vector<Transition> row(dfa->m_class_count, {NoState, 0});
+        State info{false, 0};
+
+        for (const auto &pair : closure)
+        {
+            const Program::Instruction &instruction = program[pair.first];
+
+            if (instruction.opcode == Program::Opcode::Match)
+            {
+                info = State{true, pair.second};
+                continue;
+            }
+
+            for (std::size_t c = 0; c < dfa->m_class_count; c++)
+            {
+                if (!instruction.symbols[representatives[c]])
+                {
+                    continue;
+                }
+
+                if (row[c].next != NoState)
+                {
+                    return nullptr;
+                }
+
+                row[c] = Transition{getState(pair.first + 1), pair.second};
+            }
+        }
+
+        dfa->m_table.insert(dfa->m_table.end(), row.begin(), row.end());
+        dfa->m_states.push_back(info);
+    }
+
+    return dfa;
+}
+
+bool OnePassDfa::match(
+    const char *data,
+    std::size_t size,
+    std::vector<std::size_t> &slots) const
+{
+    slots.assign(m_slot_count, Program::npos);
+
+    auto apply = [&slots](mask_t actions, std::size_t pos) {
+        for (std::size_t slot = 0; actions; slot++, actions >>= 1)
+        {
+            if (actions & 1)
+            {
+                slots[slot] = pos;
+            }
+        }
+    };
+
+    std::uint32_t state = 0;
+
+    for (std::size_t i = 0; i < size; i++)
+    {
+        const Transition &transition = m_table
+            [state * m_class_count +
+             m_classes[static_cast<unsigned char>(data[i])]];
+
+        if (transition.next == NoState)
+        {
+            return false;
+        }
+
+        apply(transition.actions, i);
+        state = transition.next;
+    }
+
+    if (!m_states[state].final)
+    {
+        return false;
+    }
+
+    apply(m_states[state].actions, size);
+    slots[0] = 0;
+    slots[1] = size;
+
+    return true;
+}
+
+} // namespace fsm
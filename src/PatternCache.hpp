@@ -0,0 +1,198 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace fsm {
+
+/// Process-wide cache of compiled patterns.
+///
+/// Entries are keyed by pattern string and compile flags and handed out as
+/// shared immutable objects. The cache is split into independently locked
+/// shards, each of which evicts its least recently used entries once it is
+/// over capacity. Concurrent requests for a pattern that is still being
+/// compiled wait for the running compilation instead of starting their own.
+template <class T>
+class PatternCache final
+{
+public: // types
+    using value_t = std::shared_ptr<const T>;
+
+public: // methods
+    explicit PatternCache(std::size_t capacity, std::size_t shards = 16)
+        : m_shards(shards == 0 ? 1 : shards)
+        , m_serial{0}
+    {
+        setCapacity(capacity);
+    }
+
+    PatternCache(const PatternCache &) = delete;
+    PatternCache &operator=(const PatternCache &) = delete;
+
+    /// Returns the value cached for (pattern, flags), calling make() to
+    /// create it on a miss. An exception thrown by make() is rethrown to
+    /// every caller waiting for that compilation and the entry is dropped.
+    template <class F>
+    value_t get(const std::string &pattern, unsigned flags, F &&make)
+    {
+        Key key{pattern, flags};
+        Shard &shard = m_shards[KeyHash()(key) % m_shards.size()];
+
+        std::promise<value_t> promise;
+        std::shared_future<value_t> future;
+        std::size_t serial = 0;
+        bool owner = false;
+
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+
+            auto it = shard.index.find(key);
+
+            if (it != shard.index.end())
+            {
+                shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+                future = it->second->value;
+            }
+            else
+            {
+                future = promise.get_future().share();
+                serial = m_serial++;
+                owner = true;
+
+                shard.lru.push_front(Entry{key, future, serial});
+                shard.index.emplace(key, shard.lru.begin());
+
+                evict(shard);
+            }
+        }
+
+        if (owner)
+        {
+            try
+            {
+                promise.set_value(make());
+            }
+            catch (...)
+            {
+                promise.set_exception(std::current_exception());
+                erase(shard, key, serial);
+            }
+        }
+
+        return future.get();
+    }
+
+    void setCapacity(std::size_t capacity)
+    {
+        std::size_t per_shard = (capacity + m_shards.size() - 1) /
+                                m_shards.size();
+        m_shard_capacity = per_shard == 0 ? 1 : per_shard;
+
+        for (Shard &shard : m_shards)
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            evict(shard);
+        }
+    }
+
+    void clear()
+    {
+        for (Shard &shard : m_shards)
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            shard.index.clear();
+            shard.lru.clear();
+        }
+    }
+
+    std::size_t size()
+    {
+        std::size_t result = 0;
+
+        for (Shard &shard : m_shards)
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            result += shard.lru.size();
+        }
+
+        return result;
+    }
+
+private: // types
+    struct Key
+    {
+        std::string pattern;
+        unsigned flags;
+
+        bool operator==(const Key &other) const
+        {
+            return flags == other.flags && pattern == other.pattern;
+        }
+    };
+
+    struct KeyHash
+    {
+        std::size_t operator()(const Key &key) const
+        {
+            return std::hash<std::string>()(key.pattern) ^
+                   (static_cast<std::size_t>(key.flags) * 0x9e3779b97f4a7c15u);
+        }
+    };
+
+    struct Entry
+    {
+        Key key;
+        std::shared_future<value_t> value;
+        std::size_t serial;
+    };
+
+    using Lru = std::list<Entry>;
+
+    struct Shard
+    {
+        std::mutex mutex;
+        Lru lru;
+        std::unordered_map<Key, typename Lru::iterator, KeyHash> index;
+    };
+
+private: // methods
+    void evict(Shard &shard)
+    {
+        while (shard.lru.size() > m_shard_capacity)
+        {
+            shard.index.erase(shard.lru.back().key);
+            shard.lru.pop_back();
+        }
+    }
+
+    void erase(Shard &shard, const Key &key, std::size_t serial)
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+
+        auto it = shard.index.find(key);
+
+        // The failed entry may already have been evicted and replaced by a
+        // newer compilation of the same pattern
+        if (it != shard.index.end() && it->second->serial == serial)
+        {
+            shard.lru.erase(it->second);
+            shard.index.erase(it);
+        }
+    }
+
+private: // fields
+    std::vector<Shard> m_shards;
+    std::atomic<std::size_t> m_shard_capacity;
+    std::atomic<std::size_t> m_serial;
+};
+
+} // namespace fsm
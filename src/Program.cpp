@@ -0,0 +1,235 @@
+#include "fsm/Program.hpp"
+#include <algorithm>
+
+namespace fsm {
+
+Program::Program(std::size_t groups, const ByteFold &fold)
+    : m_slot_count{2 * (groups + 1)}
+    , m_fold(fold)
+{
+}
+
+std::size_t Program::consume(const std::bitset<256> &symbols)
+{
+    std::size_t pc = emit(Opcode::Consume);
+
+    for (std::size_t byte = 0; byte < 256; byte++)
+    {
+        m_instructions[pc].symbols[byte] = symbols[m_fold[byte]];
+    }
+
+    return pc;
+}
+
+std::size_t Program::split()
+{
+    return emit(Opcode::Split);
+}
+
+std::size_t Program::jump()
+{
+    return emit(Opcode::Jump);
+}
+
+std::size_t Program::save(std::size_t slot)
+{
+    std::size_t pc = emit(Opcode::Save);
+    m_instructions[pc].x = slot;
+    return pc;
+}
+
+std::size_t Program::match()
+{
+    return emit(Opcode::Match);
+}
+
+Program::Instruction &Program::operator[](std::size_t pc)
+{
+    return m_instructions[pc];
+}
+
+const Program::Instruction &Program::operator[](std::size_t pc) const
+{
+    return m_instructions[pc];
+}
+
+std::size_t Program::size() const
+{
+    return m_instructions.size();
+}
+
+std::size_t Program::getSlotCount() const
+{
+    return m_slot_count;
+}
+
+bool Program::run(
+    const char *data,
+    std::size_t size,
+    std::vector<std::size_t> &slots,
+    Threads &threads) const
+{
+    const std::size_t n = m_slot_count;
+
+    std::size_t current = 0;
+    std::size_t next = 1;
+
+    start(threads);
+
+    for (std::size_t i = 0; i <= size; i++)
+    {
+        threads.m_size[next] = 0;
+
+        for (std::size_t k = 0; k < threads.m_size[current]; k++)
+        {
+            const Instruction &instruction =
+                m_instructions[threads.m_dense[current][k]];
+            auto thread_slots = threads.m_slots[current].begin() + k * n;
+
+            if (instruction.opcode == Opcode::Match && i == size)
+            {
+                // Threads are ordered by priority, so the first one to match
+                // at the end of the input wins
+                slots.assign(thread_slots, thread_slots + n);
+                slots[1] = size;
+                return true;
+            }
+
+            if (instruction.opcode == Opcode::Consume && i < size &&
+                instruction.symbols[static_cast<unsigned char>(data[i])])
+            {
+                std::copy(
+                    thread_slots, thread_slots + n, threads.m_current.begin());
+                addThread(
+                    threads, next, threads.m_dense[current][k] + 1, i + 1);
+            }
+        }
+
+        if (threads.m_size[next] == 0)
+        {
+            break;
+        }
+
+        std::swap(current, next);
+    }
+
+    return false;
+}
+
+std::size_t Program::matchLongest(
+    const char *data,
+    std::size_t size,
+    Threads &threads) const
+{
+    std::size_t longest = npos;
+
+    std::size_t current = 0;
+    std::size_t next = 1;
+
+    start(threads);
+
+    for (std::size_t i = 0; i <= size; i++)
+    {
+        threads.m_size[next] = 0;
+
+        for (std::size_t k = 0; k < threads.m_size[current]; k++)
+        {
+            const Instruction &instruction =
+                m_instructions[threads.m_dense[current][k]];
+
+            if (instruction.opcode == Opcode::Match)
+            {
+                longest = i;
+            }
+
+            if (instruction.opcode == Opcode::Consume && i < size &&
+                instruction.symbols[static_cast<unsigned char>(data[i])])
+            {
+                addThread(
+                    threads, next, threads.m_dense[current][k] + 1, i + 1);
+            }
+        }
+
+        if (threads.m_size[next] == 0)
+        {
+            break;
+        }
+
+        std::swap(current, next);
+    }
+
+    return longest;
+}
+
+void Program::start(Threads &threads) const
+{
+    for (std::size_t list = 0; list < 2; list++)
+    {
+        threads.m_sparse[list].resize(m_instructions.size());
+        threads.m_dense[list].resize(m_instructions.size());
+        threads.m_slots[list].resize(m_instructions.size() * m_slot_count);
+        threads.m_size[list] = 0;
+    }
+
+    threads.m_current.assign(m_slot_count, npos);
+    threads.m_current[0] = 0;
+
+    addThread(threads, 0, 0, 0);
+}
+
+std::size_t Program::emit(Opcode opcode)
+{
+    m_instructions.push_back(Instruction{opcode, {}, 0, 0});
+    return m_instructions.size() - 1;
+}
+
+void Program::addThread(
+    Threads &threads,
+    std::size_t list,
+    std::size_t pc,
+    std::size_t pos) const
+{
+    std::size_t index = threads.m_sparse[list][pc];
+
+    if (index < threads.m_size[list] && threads.m_dense[list][index] == pc)
+    {
+        return;
+    }
+
+    index = threads.m_size[list]++;
+    threads.m_sparse[list][pc] = index;
+    threads.m_dense[list][index] = pc;
+
+    std::copy(
+        threads.m_current.begin(),
+        threads.m_current.end(),
+        threads.m_slots[list].begin() + index * m_slot_count);
+
+    const Instruction &instruction = m_instructions[pc];
+
+    switch (instruction.opcode)
+    {
+    case Opcode::Jump:
+        addThread(threads, list, instruction.x, pos);
+        break;
+
+    case Opcode::Split:
+        addThread(threads, list, instruction.x, pos);
+        addThread(threads, list, instruction.y, pos);
+        break;
+
+    case Opcode::Save:
+    {
+        std::size_t saved = threads.m_current[instruction.x];
+        threads.m_current[instruction.x] = pos;
+        addThread(threads, list, pc + 1, pos);
+        threads.m_current[instruction.x] = saved;
+        break;
+    }
+
+    default:
+        break;
+    }
+}
+
+} // namespace fsm
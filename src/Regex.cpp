@@ -1,10 +1,28 @@
 #include "fsm/Regex.hpp"
+#include <algorithm>
+#include <atomic>
+#include <bitset>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
 #include <iostream>
+#include <memory_resource>
+#include <mutex>
 #include <stdexcept>
+#include <thread>
 #include <tuple>
 #include <utility>
 #include <vector>
+#include "fsm/Dfa.hpp"
 #include "fsm/Fsm.hpp"
+#include "fsm/GlushkovNfa.hpp"
+#include "fsm/LiteralMatcher.hpp"
+#include "fsm/OnePassDfa.hpp"
+#include "fsm/Program.hpp"
+#include "fsm/ShengDfa.hpp"
+#include "fsm/SpanFinder.hpp"
+#include "PatternCache.hpp"
 
 namespace fsm {
 
@@ -46,6 +64,15 @@ private:
     std::size_t m_indent;
 };
 
+/// First and last positions of a subexpression and whether it matches the
+/// empty string
+struct PositionSets
+{
+    bool nullable;
+    GlushkovNfa::mask_t first;
+    GlushkovNfa::mask_t last;
+};
+
 class Node
 {
 public:
@@ -54,7 +81,14 @@ public:
     }
 
     virtual void print(NodePrintContext &ctx) = 0;
-    virtual Fsm compile() = 0;
+    virtual Fsm compile(Fsm::allocator_type alloc) = 0;
+    virtual PositionSets positions(GlushkovNfa::Builder &builder) = 0;
+    virtual void emit(Program &program) = 0;
+
+    /// Stores in literals the strings matched by the node if there are at
+    /// most limit of them, returns false otherwise
+    virtual bool expand(std::vector<std::string> &literals, std::size_t limit)
+        = 0;
 };
 
 using NodePtr = std::shared_ptr<Node>;
@@ -73,15 +107,37 @@ public:
             "CharacterNode { \"", m_char == '"' ? "\\" : "", m_char, "\" }\n");
     }
 
-    Fsm compile() override
+    Fsm compile(Fsm::allocator_type alloc) override
     {
-        Fsm fsm(2);
+        Fsm fsm(2, {}, {}, alloc);
         fsm.setStarting(0);
         fsm.setFinal(1);
         fsm.connect(0, 1, m_char);
         return fsm;
     }
 
+    PositionSets positions(GlushkovNfa::Builder &builder) override
+    {
+        std::bitset<256> symbols;
+        symbols.set(static_cast<unsigned char>(m_char));
+
+        GlushkovNfa::mask_t p = builder.addPosition(symbols);
+        return {false, p, p};
+    }
+
+    void emit(Program &program) override
+    {
+        std::bitset<256> symbols;
+        symbols.set(static_cast<unsigned char>(m_char));
+        program.consume(symbols);
+    }
+
+    bool expand(std::vector<std::string> &literals, std::size_t) override
+    {
+        literals.assign(1, std::string(1, m_char));
+        return true;
+    }
+
 private:
     char m_char;
 };
@@ -113,9 +169,9 @@ public:
         ctx.print("}\n");
     }
 
-    Fsm compile() override
+    Fsm compile(Fsm::allocator_type alloc) override
     {
-        Fsm fsm(2);
+        Fsm fsm(2, {}, {}, alloc);
         fsm.setStarting(0);
         fsm.setFinal(1);
         for (const auto &pair : m_sets)
@@ -128,6 +184,52 @@ public:
         return fsm;
     }
 
+    PositionSets positions(GlushkovNfa::Builder &builder) override
+    {
+        std::bitset<256> symbols;
+        for (const auto &pair : m_sets)
+        {
+            for (int c = pair.first; c <= pair.second; c++)
+            {
+                symbols.set(static_cast<unsigned char>(c));
+            }
+        }
+
+        GlushkovNfa::mask_t p = builder.addPosition(symbols);
+        return {false, p, p};
+    }
+
+    void emit(Program &program) override
+    {
+        std::bitset<256> symbols;
+        for (const auto &pair : m_sets)
+        {
+            for (int c = pair.first; c <= pair.second; c++)
+            {
+                symbols.set(static_cast<unsigned char>(c));
+            }
+        }
+        program.consume(symbols);
+    }
+
+    bool expand(std::vector<std::string> &literals, std::size_t limit) override
+    {
+        literals.clear();
+        for (const auto &pair : m_sets)
+        {
+            for (int c = pair.first; c <= pair.second; c++)
+            {
+                if (literals.size() == limit)
+                {
+                    return false;
+                }
+
+                literals.emplace_back(1, static_cast<char>(c));
+            }
+        }
+        return true;
+    }
+
 private:
     std::vector<std::pair<char, char>> m_sets;
 };
@@ -140,9 +242,50 @@ public:
         ctx.print("WildcardNode {}\n");
     }
 
-    Fsm compile() override
+    Fsm compile(Fsm::allocator_type alloc) override
+    {
+        std::bitset<256> symbols = getSymbols();
+
+        Fsm fsm(2, {}, {}, alloc);
+        fsm.setStarting(0);
+        fsm.setFinal(1);
+        for (int c = 0; c < 256; c++)
+        {
+            if (symbols[c])
+            {
+                fsm.connect(0, 1, static_cast<char>(c));
+            }
+        }
+        return fsm;
+    }
+
+    PositionSets positions(GlushkovNfa::Builder &builder) override
+    {
+        GlushkovNfa::mask_t p = builder.addPosition(getSymbols());
+        return {false, p, p};
+    }
+
+    void emit(Program &program) override
+    {
+        program.consume(getSymbols());
+    }
+
+    bool expand(std::vector<std::string> &, std::size_t) override
+    {
+        return false;
+    }
+
+private:
+    /// Every byte but the line terminators, as in ECMAScript, and '\0',
+    /// which stands for epsilon edges in FSMs
+    static std::bitset<256> getSymbols()
     {
-        return Fsm(0);
+        std::bitset<256> symbols;
+        symbols.set();
+        symbols.reset(0);
+        symbols.reset('\n');
+        symbols.reset('\r');
+        return symbols;
     }
 };
 
@@ -166,14 +309,66 @@ public:
         ctx.print("}\n");
     }
 
-    Fsm compile() override
+    Fsm compile(Fsm::allocator_type alloc) override
     {
         std::vector<Fsm> fsms;
         for (const auto &node : m_nodes)
         {
-            fsms.emplace_back(node->compile());
+            fsms.emplace_back(node->compile(alloc));
+        }
+        return Fsm::concatenation(fsms, alloc);
+    }
+
+    PositionSets positions(GlushkovNfa::Builder &builder) override
+    {
+        PositionSets result{true, 0, 0};
+        for (const auto &node : m_nodes)
+        {
+            PositionSets sets = node->positions(builder);
+            builder.addFollow(result.last, sets.first);
+
+            if (result.nullable)
+            {
+                result.first |= sets.first;
+            }
+
+            result.last = sets.nullable ? result.last | sets.last : sets.last;
+            result.nullable = result.nullable && sets.nullable;
+        }
+        return result;
+    }
+
+    void emit(Program &program) override
+    {
+        for (const auto &node : m_nodes)
+        {
+            node->emit(program);
+        }
+    }
+
+    bool expand(std::vector<std::string> &literals, std::size_t limit) override
+    {
+        literals.assign(1, std::string());
+        for (const auto &node : m_nodes)
+        {
+            std::vector<std::string> suffixes;
+            if (!node->expand(suffixes, limit) ||
+                literals.size() * suffixes.size() > limit)
+            {
+                return false;
+            }
+
+            std::vector<std::string> product;
+            for (const auto &prefix : literals)
+            {
+                for (const auto &suffix : suffixes)
+                {
+                    product.push_back(prefix + suffix);
+                }
+            }
+            literals.swap(product);
         }
-        return Fsm::concatenation(fsms);
+        return true;
     }
 
 private:
@@ -200,14 +395,65 @@ public:
         ctx.print("}\n");
     }
 
-    Fsm compile() override
+    Fsm compile(Fsm::allocator_type alloc) override
     {
         std::vector<Fsm> fsms;
         for (const auto &node : m_nodes)
         {
-            fsms.emplace_back(node->compile());
+            fsms.emplace_back(node->compile(alloc));
+        }
+        return Fsm::disjunction(fsms, alloc);
+    }
+
+    PositionSets positions(GlushkovNfa::Builder &builder) override
+    {
+        PositionSets result{false, 0, 0};
+        for (const auto &node : m_nodes)
+        {
+            PositionSets sets = node->positions(builder);
+            result.nullable = result.nullable || sets.nullable;
+            result.first |= sets.first;
+            result.last |= sets.last;
+        }
+        return result;
+    }
+
+    void emit(Program &program) override
+    {
+        std::vector<std::size_t> jumps;
+        for (std::size_t i = 0; i + 1 < m_nodes.size(); i++)
+        {
+            std::size_t split = program.split();
+            program[split].x = split + 1;
+            m_nodes[i]->emit(program);
+            jumps.push_back(program.jump());
+            program[split].y = program.size();
+        }
+
+        m_nodes.back()->emit(program);
+
+        for (std::size_t jump : jumps)
+        {
+            program[jump].x = program.size();
+        }
+    }
+
+    bool expand(std::vector<std::string> &literals, std::size_t limit) override
+    {
+        literals.clear();
+        for (const auto &node : m_nodes)
+        {
+            std::vector<std::string> alternatives;
+            if (!node->expand(alternatives, limit) ||
+                literals.size() + alternatives.size() > limit)
+            {
+                return false;
+            }
+
+            literals.insert(
+                literals.end(), alternatives.begin(), alternatives.end());
         }
-        return Fsm::disjunction(fsms);
+        return true;
     }
 
 private:
@@ -231,9 +477,31 @@ public:
         ctx.print("}\n");
     }
 
-    Fsm compile() override
+    Fsm compile(Fsm::allocator_type alloc) override
+    {
+        return Fsm::iteration(m_node->compile(alloc));
+    }
+
+    PositionSets positions(GlushkovNfa::Builder &builder) override
+    {
+        PositionSets sets = m_node->positions(builder);
+        builder.addFollow(sets.last, sets.first);
+        return sets;
+    }
+
+    void emit(Program &program) override
+    {
+        std::size_t start = program.size();
+        m_node->emit(program);
+
+        std::size_t split = program.split();
+        program[split].x = start;
+        program[split].y = split + 1;
+    }
+
+    bool expand(std::vector<std::string> &, std::size_t) override
     {
-        return Fsm::iteration(m_node->compile());
+        return false;
     }
 
 private:
@@ -257,22 +525,101 @@ public:
         ctx.print("}\n");
     }
 
-    Fsm compile() override
+    Fsm compile(Fsm::allocator_type alloc) override
+    {
+        return Fsm::option(m_node->compile(alloc));
+    }
+
+    PositionSets positions(GlushkovNfa::Builder &builder) override
+    {
+        PositionSets sets = m_node->positions(builder);
+        sets.nullable = true;
+        return sets;
+    }
+
+    void emit(Program &program) override
+    {
+        std::size_t split = program.split();
+        program[split].x = split + 1;
+        m_node->emit(program);
+        program[split].y = program.size();
+    }
+
+    bool expand(std::vector<std::string> &literals, std::size_t limit) override
+    {
+        if (!m_node->expand(literals, limit) || literals.size() == limit)
+        {
+            return false;
+        }
+
+        literals.emplace_back();
+        return true;
+    }
+
+private:
+    NodePtr m_node;
+};
+
+class CaptureNode : public Node
+{
+public:
+    CaptureNode(std::size_t index, NodePtr node)
+        : m_index{index}
+        , m_node{node}
+    {
+    }
+
+    void print(NodePrintContext &ctx) override
+    {
+        ctx.print("CaptureNode { ", m_index, "\n");
+        ctx.indent();
+        m_node->print(ctx);
+        ctx.unindent();
+        ctx.print("}\n");
+    }
+
+    Fsm compile(Fsm::allocator_type alloc) override
+    {
+        return m_node->compile(alloc);
+    }
+
+    PositionSets positions(GlushkovNfa::Builder &builder) override
+    {
+        return m_node->positions(builder);
+    }
+
+    void emit(Program &program) override
+    {
+        program.save(2 * m_index);
+        m_node->emit(program);
+        program.save(2 * m_index + 1);
+    }
+
+    bool expand(std::vector<std::string> &literals, std::size_t limit) override
     {
-        return Fsm::option(m_node->compile());
+        return m_node->expand(literals, limit);
     }
 
 private:
+    std::size_t m_index;
     NodePtr m_node;
 };
 
 class RegexParser final
 {
 public: // methods
+    /// Creates a parser that replaces every character of the pattern by the
+    /// character it folds to
+    explicit RegexParser(const ByteFold &fold = identityFold())
+        : m_fold(fold)
+    {
+    }
+
     NodePtr parse(const std::string &pattern)
     {
         m_pattern = pattern;
         m_pos = 0;
+        m_groups = 0;
 
         getChar();
 
@@ -288,6 +635,11 @@ public: // methods
         return node;
     }
 
+    std::size_t getGroupCount() const
+    {
+        return m_groups;
+    }
+
 private: // methods
     void getChar()
     {
@@ -382,19 +734,34 @@ private: // methods
         }
         else if (accept('('))
         {
-            std::vector<NodePtr> nodes;
+            std::size_t index = 0;
 
-            if (!accept(')'))
+            if (accept('?'))
             {
-                do
+                if (m_char != ':')
                 {
-                    nodes.emplace_back(expr());
-                } while (accept('|'));
-
-                if (!accept(')'))
-                {
-                    throw std::runtime_error("unmatched parentheses");
+                    throw std::runtime_error("invalid group");
                 }
+
+                getChar();
+            }
+            else
+            {
+                index = ++m_groups;
+            }
+
+            // An empty group, like an empty alternative, is the empty
+            // concatenation that expr() returns and matches ""
+            std::vector<NodePtr> nodes;
+
+            do
+            {
+                nodes.emplace_back(expr());
+            } while (accept('|'));
+
+            if (!accept(')'))
+            {
+                throw std::runtime_error("unmatched parentheses");
             }
 
             if (nodes.size() == 1)
@@ -405,6 +772,11 @@ private: // methods
             {
                 node.reset(new GroupNode(nodes));
             }
+
+            if (index != 0)
+            {
+                node.reset(new CaptureNode(index, node));
+            }
         }
         else if (accept('['))
         {
@@ -452,7 +824,7 @@ private: // methods
                 throw std::runtime_error("unmatched brackets");
             }
 
-            node.reset(new CharacterSetNode(sets));
+            node.reset(new CharacterSetNode(foldSets(sets)));
         }
         else if (m_char < 0 && !check('|') && !check(')'))
         {
@@ -461,50 +833,944 @@ private: // methods
         }
         else
         {
-            node.reset(new CharacterNode(m_char));
+            node.reset(new CharacterNode(
+                static_cast<char>(m_fold[static_cast<unsigned char>(m_char)])));
             getChar();
         }
 
         return node;
     }
 
+    std::vector<std::pair<char, char>> foldSets(
+        const std::vector<std::pair<char, char>> &sets) const
+    {
+        std::bitset<256> symbols;
+
+        for (const auto &pair : sets)
+        {
+            for (int c = pair.first; c <= pair.second; c++)
+            {
+                symbols.set(m_fold[static_cast<unsigned char>(c)]);
+            }
+        }
+
+        // Ranges are compared as chars by the nodes, so they must not
+        // straddle the boundary between positive and negative chars
+        std::vector<std::pair<char, char>> folded;
+
+        for (int byte = 0; byte < 256; byte++)
+        {
+            if (!symbols[byte])
+            {
+                continue;
+            }
+
+            char c = static_cast<char>(byte);
+
+            if (!folded.empty() && byte != 128 &&
+                static_cast<unsigned char>(folded.back().second) + 1 == byte)
+            {
+                folded.back().second = c;
+            }
+            else
+            {
+                folded.emplace_back(c, c);
+            }
+        }
+
+        return folded;
+    }
+
 private: // fields
+    ByteFold m_fold;
     std::string m_pattern;
     std::size_t m_pos;
     char m_char;
+    std::size_t m_groups;
 };
 
-class RegexImpl final
+/// Per-thread buffers of the matching engines
+class ScratchImpl final
+{
+public: // fields
+    Program::Threads threads;
+    std::vector<std::size_t> slots;
+};
+
+/// Worker threads building the DFAs of deferred patterns, in the order the
+/// patterns were compiled
+class BackgroundCompiler final
 {
+public: // types
+    /// Task given the flag raised on shutdown, to be checked between steps
+    using task_t = std::function<void(const std::atomic<bool> &stop)>;
+
 public: // methods
-    RegexImpl(const std::string &pattern)
-        : m_fsm{Regex::buildFsm(pattern).min()}
+    BackgroundCompiler()
+        : m_stop{false}
+    {
+        std::size_t threads =
+            std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+
+        for (std::size_t i = 0; i < threads; i++)
+        {
+            m_workers.emplace_back([this]() { work(); });
+        }
+    }
+
+    /// Drops the tasks not started yet and waits for the running ones to
+    /// finish their current step
+    ~BackgroundCompiler()
     {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+
+        m_condition.notify_all();
+
+        for (std::thread &worker : m_workers)
+        {
+            worker.join();
+        }
     }
 
-    bool match(const std::string &str)
+    void submit(task_t task)
     {
-        ///@todo Implement
-        return false;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_tasks.push_back(std::move(task));
+        }
+
+        m_condition.notify_one();
+    }
+
+private: // methods
+    void work()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+
+        while (true)
+        {
+            m_condition.wait(
+                lock, [this]() { return m_stop || !m_tasks.empty(); });
+
+            if (m_stop)
+            {
+                return;
+            }
+
+            task_t task = std::move(m_tasks.front());
+            m_tasks.pop_front();
+
+            lock.unlock();
+            task(m_stop);
+            lock.lock();
+        }
     }
 
 private: // fields
-    Fsm m_fsm;
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::deque<task_t> m_tasks;
+    std::atomic<bool> m_stop;
+    std::vector<std::thread> m_workers;
+};
+
+static BackgroundCompiler &backgroundCompiler()
+{
+    static BackgroundCompiler compiler;
+    return compiler;
+}
+
+/// DFA engines of a pattern. They are only read once ready is set, which
+/// lets a background thread build them while the pattern is in use. The
+/// compilation is finished once the engines are ready or known not to fit,
+/// and the span finder, only built in the background, is read after that.
+struct CompiledDfa
+{
+    std::unique_ptr<const Dfa> dfa;
+    std::unique_ptr<const ShengDfa> sheng;
+    std::unique_ptr<const SpanFinder> span_finder;
+    std::atomic<bool> ready{false};
+    std::atomic<bool> finished{false};
 };
 
-Regex::Regex(const std::string &pattern)
-    : m_impl{new RegexImpl{pattern}}
+class RegexImpl final
+{
+public: // methods
+    RegexImpl(const std::string &pattern, unsigned flags)
+        : m_pattern{pattern}
+        , m_fold(flags & Regex::IgnoreCase ? caseFold() : identityFold())
+        , m_deferred{(flags & Regex::Deferred) != 0}
+    {
+        RegexParser parser(m_fold);
+        NodePtr node = parser.parse(pattern);
+
+        m_captures = parser.getGroupCount();
+
+        std::vector<std::string> literals;
+
+        if (node->expand(literals, LiteralMatcher::MaxLiterals) &&
+            LiteralMatcher::fits(literals) && isFoldInvariant(literals))
+        {
+            m_literals.reset(new LiteralMatcher(literals));
+        }
+        else
+        {
+            buildMatcher(node, flags & Regex::Deferred);
+        }
+
+        if (m_captures > 0)
+        {
+            buildSubmatcher(node);
+        }
+
+        // Submitted last, as the compilation reads the syntax tree. The
+        // task is skipped if the regex is gone by the time it starts, and a
+        // DFA that cannot be built leaves the interim engines in place.
+        if (m_compiled && !m_compiled->finished)
+        {
+            std::shared_ptr<CompiledDfa> compiled = m_compiled;
+            ByteFold fold = m_fold;
+            std::size_t max_states = m_max_dfa_states;
+
+            backgroundCompiler().submit([compiled, node, fold, max_states](
+                                            const std::atomic<bool> &stop) {
+                if (compiled.use_count() > 1 && !stop)
+                {
+                    try
+                    {
+                        if (compileDfa(
+                                node, fold, max_states, *compiled, &stop) &&
+                            !stop)
+                        {
+                            std::pmr::monotonic_buffer_resource arena;
+                            compiled->span_finder = SpanFinder::build(
+                                node->compile(&arena).simplify(), fold,
+                                MaxSpanStates);
+                        }
+                    }
+                    catch (const std::exception &)
+                    {
+                    }
+                }
+
+                compiled->finished.store(true, std::memory_order_release);
+            });
+        }
+    }
+
+    bool isCompiled() const
+    {
+        return !m_compiled ||
+               m_compiled->finished.load(std::memory_order_acquire);
+    }
+
+    bool match(const std::string &str, ScratchImpl &scratch) const
+    {
+        return match(str.data(), str.size(), scratch);
+    }
+
+    bool match(
+        const std::string &str,
+        std::vector<Regex::Submatch> &submatches,
+        ScratchImpl &scratch) const
+    {
+        std::vector<std::size_t> &slots = scratch.slots;
+        bool matched;
+
+        if (m_onepass)
+        {
+            matched = m_onepass->match(str.data(), str.size(), slots);
+        }
+        else if (m_program)
+        {
+            // The VM is much slower than the matchers, so let them reject
+            // the input first
+            matched = match(str.data(), str.size(), scratch) &&
+                      m_program->run(
+                          str.data(), str.size(), slots, scratch.threads);
+        }
+        else
+        {
+            matched = match(str.data(), str.size(), scratch);
+            slots.assign({0, str.size()});
+        }
+
+        submatches.clear();
+
+        if (!matched)
+        {
+            return false;
+        }
+
+        for (std::size_t i = 0; i + 1 < slots.size(); i += 2)
+        {
+            submatches.push_back(Regex::Submatch{slots[i], slots[i + 1]});
+        }
+
+        return true;
+    }
+
+    std::size_t getCaptureCount() const
+    {
+        return m_captures;
+    }
+
+    bool find(
+        const std::string &str,
+        std::size_t pos,
+        SpanFinder::span_t &span,
+        ScratchImpl &scratch) const
+    {
+        if (const SpanFinder *finder = getSpanFinder())
+        {
+            return finder->find(str.data(), str.size(), pos, span);
+        }
+
+        // Without a span finder every start is tried in turn
+        for (std::size_t begin = pos; begin <= str.size(); begin++)
+        {
+            std::size_t length = matchLongest(
+                str.data() + begin, str.size() - begin, scratch);
+
+            if (length != Regex::npos)
+            {
+                span = SpanFinder::span_t(begin, begin + length);
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    void findAll(
+        const std::string &str,
+        std::vector<SpanFinder::span_t> &spans,
+        ScratchImpl &scratch) const
+    {
+        if (const SpanFinder *finder = getSpanFinder())
+        {
+            finder->findAll(str.data(), str.size(), spans);
+            return;
+        }
+
+        spans.clear();
+
+        for (std::size_t begin = 0; begin <= str.size(); begin++)
+        {
+            std::size_t length = matchLongest(
+                str.data() + begin, str.size() - begin, scratch);
+
+            if (length == Regex::npos)
+            {
+                continue;
+            }
+
+            spans.emplace_back(begin, begin + length);
+
+            // An empty match is not repeated at the same position
+            if (length > 0)
+            {
+                begin += length - 1;
+            }
+        }
+    }
+
+    bool search(const std::string &str, ScratchImpl &scratch) const
+    {
+        if (m_literals)
+        {
+            return m_literals->search(str.data(), str.size());
+        }
+
+        if (m_glushkov)
+        {
+            return m_glushkov->search(str.data(), str.size());
+        }
+
+        const CompiledDfa *compiled = getCompiled();
+
+        if (!compiled)
+        {
+            if (m_interim_nfa)
+            {
+                return m_interim_nfa->search(str.data(), str.size());
+            }
+
+            return runInterim(
+                *m_interim_search, str.data(), str.size(), scratch);
+        }
+
+        std::call_once(m_search_once, [this, compiled]() {
+            m_search_dfa = compiled->dfa->unanchored(MaxSearchStates);
+        });
+
+        if (m_search_dfa)
+        {
+            return m_search_dfa->search(str.data(), str.size());
+        }
+
+        // Try every starting position, each walk stopping as soon as the
+        // DFA accepts or dies
+        for (std::size_t i = 0; i <= str.size(); i++)
+        {
+            if (compiled->dfa->search(str.data() + i, str.size() - i))
+            {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    void matchBatch(
+        const std::vector<std::string_view> &strs,
+        std::vector<bool> &out) const
+    {
+        const CompiledDfa *compiled = getCompiled();
+
+        if (compiled && compiled->sheng)
+        {
+            compiled->sheng->matchBatch(strs, out);
+            return;
+        }
+
+        if (compiled)
+        {
+            compiled->dfa->matchBatch(strs, out);
+            return;
+        }
+
+        out.assign(strs.size(), false);
+
+        ScratchImpl scratch;
+
+        for (std::size_t i = 0; i < strs.size(); i++)
+        {
+            out[i] = match(strs[i].data(), strs[i].size(), scratch);
+        }
+    }
+
+    static ScratchImpl &getScratch(Regex::Scratch &scratch)
+    {
+        return *scratch.m_impl;
+    }
+
+private: // methods
+    void buildMatcher(const NodePtr &node, bool deferred)
+    {
+        GlushkovNfa::Builder builder;
+        PositionSets sets = node->positions(builder);
+
+        // Patterns smaller than this determinize quickly and usually fit
+        // the shuffle engine. Larger ones that the bit-parallel NFA can run
+        // only get a DFA if determinization stays small.
+        m_max_dfa_states = Fsm::npos;
+
+        if (!builder.overflow() &&
+            builder.getPositionCount() >= ShengDfa::MaxStates)
+        {
+            m_max_dfa_states = MaxBoundedDfaStates;
+        }
+
+        m_compiled = std::make_shared<CompiledDfa>();
+
+        if (!deferred)
+        {
+            if (!compileDfa(node, m_fold, m_max_dfa_states, *m_compiled))
+            {
+                m_compiled.reset();
+                m_glushkov.reset(new GlushkovNfa(builder.build(
+                    sets.first, sets.last, sets.nullable, m_fold)));
+                return;
+            }
+
+            m_compiled->finished.store(true, std::memory_order_release);
+            return;
+        }
+
+        // Until the DFA is ready the pattern is matched by NFA simulation,
+        // bit-parallel if it is small enough and by the VM otherwise
+        if (!builder.overflow())
+        {
+            m_interim_nfa.reset(new GlushkovNfa(
+                builder.build(sets.first, sets.last, sets.nullable, m_fold)));
+        }
+        else
+        {
+            m_interim_match = buildProgram(node, false);
+            m_interim_search = buildProgram(node, true);
+        }
+    }
+
+    /// Builds the DFA engines of the pattern, or returns false if the DFA
+    /// would need more than max_states states or stop was raised before
+    /// determinization
+    static bool compileDfa(
+        const NodePtr &node,
+        const ByteFold &fold,
+        std::size_t max_states,
+        CompiledDfa &compiled,
+        const std::atomic<bool> *stop = nullptr)
+    {
+        // The NFA and every automaton min() goes through are garbage once
+        // the table exists, so they share one arena
+        std::pmr::monotonic_buffer_resource arena;
+        Fsm nfa = node->compile(&arena).simplify();
+
+        if (stop && *stop)
+        {
+            return false;
+        }
+
+        std::unique_ptr<Fsm> fsm = nfa.min(max_states);
+
+        if (!fsm)
+        {
+            return false;
+        }
+
+        compiled.dfa.reset(new Dfa(*fsm, fold));
+
+        if (ShengDfa::fits(*compiled.dfa))
+        {
+            compiled.sheng.reset(new ShengDfa(*compiled.dfa));
+        }
+
+        compiled.ready.store(true, std::memory_order_release);
+
+        return true;
+    }
+
+    /// Returns a program matching the whole input against the pattern or,
+    /// if unanchored, matching any input that contains the pattern
+    std::unique_ptr<const Program> buildProgram(
+        const NodePtr &node,
+        bool unanchored) const
+    {
+        std::unique_ptr<Program> program(new Program(m_captures, m_fold));
+
+        std::bitset<256> all;
+        all.set();
+
+        auto emitAnything = [&]() {
+            std::size_t split = program->split();
+            (*program)[split].x = split + 1;
+            program->consume(all);
+            (*program)[program->jump()].x = split;
+            (*program)[split].y = program->size();
+        };
+
+        if (unanchored)
+        {
+            emitAnything();
+        }
+
+        node->emit(*program);
+
+        if (unanchored)
+        {
+            emitAnything();
+        }
+
+        program->match();
+
+        return program;
+    }
+
+    static bool runInterim(
+        const Program &program,
+        const char *data,
+        std::size_t size,
+        ScratchImpl &scratch)
+    {
+        return program.run(data, size, scratch.slots, scratch.threads);
+    }
+
+    /// Returns the span finder, or null if its DFAs would be too large or,
+    /// for a Deferred regex, until the background compilation is finished.
+    /// Others build it on first use.
+    const SpanFinder *getSpanFinder() const
+    {
+        if (m_compiled && m_deferred)
+        {
+            return isCompiled() ? m_compiled->span_finder.get() : nullptr;
+        }
+
+        std::call_once(m_span_finder_once, [this]() {
+            std::pmr::monotonic_buffer_resource arena;
+            NodePtr node = RegexParser(m_fold).parse(m_pattern);
+            m_span_finder = SpanFinder::build(
+                node->compile(&arena).simplify(), m_fold, MaxSpanStates);
+
+            // Literals have no engine of their own to try starts with
+            if (!m_span_finder && m_literals)
+            {
+                m_longest_program = buildProgram(node, false);
+            }
+        });
+
+        return m_span_finder.get();
+    }
+
+    /// Returns the length of the longest match at the start of the input,
+    /// or npos, for a regex without a span finder
+    std::size_t matchLongest(
+        const char *data,
+        std::size_t size,
+        ScratchImpl &scratch) const
+    {
+        if (const CompiledDfa *compiled = getCompiled())
+        {
+            return compiled->dfa->matchLongest(data, size);
+        }
+
+        if (m_glushkov)
+        {
+            return m_glushkov->matchLongest(data, size);
+        }
+
+        if (m_interim_nfa)
+        {
+            return m_interim_nfa->matchLongest(data, size);
+        }
+
+        const Program &program =
+            m_interim_match ? *m_interim_match : *m_longest_program;
+
+        return program.matchLongest(data, size, scratch.threads);
+    }
+
+    const CompiledDfa *getCompiled() const
+    {
+        if (m_compiled && m_compiled->ready.load(std::memory_order_acquire))
+        {
+            return m_compiled.get();
+        }
+
+        return nullptr;
+    }
+
+    void buildSubmatcher(const NodePtr &node)
+    {
+        std::unique_ptr<Program> program(new Program(m_captures, m_fold));
+        node->emit(*program);
+        program->match();
+
+        m_onepass = OnePassDfa::build(*program);
+
+        if (!m_onepass)
+        {
+            m_program = std::move(program);
+        }
+    }
+
+    /// Returns true if no byte of the literals is folded to another one or
+    /// has another one folded to it, so that they match case-sensitively
+    bool isFoldInvariant(const std::vector<std::string> &literals) const
+    {
+        std::bitset<256> folded;
+
+        for (std::size_t byte = 0; byte < 256; byte++)
+        {
+            if (m_fold[byte] != byte)
+            {
+                folded.set(byte);
+                folded.set(m_fold[byte]);
+            }
+        }
+
+        for (const std::string &literal : literals)
+        {
+            for (char c : literal)
+            {
+                if (folded[static_cast<unsigned char>(c)])
+                {
+                    return false;
+                }
+            }
+        }
+
+        return true;
+    }
+
+    bool match(const char *data, std::size_t size, ScratchImpl &scratch) const
+    {
+        if (m_literals)
+        {
+            return m_literals->match(data, size);
+        }
+
+        if (m_glushkov)
+        {
+            return m_glushkov->match(data, size);
+        }
+
+        const CompiledDfa *compiled = getCompiled();
+
+        if (!compiled)
+        {
+            if (m_interim_nfa)
+            {
+                return m_interim_nfa->match(data, size);
+            }
+
+            return runInterim(*m_interim_match, data, size, scratch);
+        }
+
+        if (compiled->sheng)
+        {
+            return compiled->sheng->match(data, size);
+        }
+
+        return compiled->dfa->match(data, size);
+    }
+
+private: // types
+    static const std::size_t MaxSearchStates = 10000;
+
+    /// States allowed to each DFA of a span finder
+    static const std::size_t MaxSpanStates = 1024;
+
+    /// States allowed to the DFA of a pattern the NFA could match instead
+    static const std::size_t MaxBoundedDfaStates = 256;
+
+private: // fields
+    std::string m_pattern;
+    ByteFold m_fold;
+    bool m_deferred;
+
+    std::unique_ptr<const LiteralMatcher> m_literals;
+    std::shared_ptr<CompiledDfa> m_compiled;
+    std::size_t m_max_dfa_states;
+    std::unique_ptr<const GlushkovNfa> m_glushkov;
+    std::unique_ptr<const Program> m_program;
+    std::unique_ptr<const OnePassDfa> m_onepass;
+    std::size_t m_captures;
+
+    // Engines of a deferred pattern until its DFA is compiled
+    std::unique_ptr<const GlushkovNfa> m_interim_nfa;
+    std::unique_ptr<const Program> m_interim_match;
+    std::unique_ptr<const Program> m_interim_search;
+
+    // Built on first use, the only state that changes after construction
+    mutable std::once_flag m_search_once;
+    mutable std::unique_ptr<const Dfa> m_search_dfa;
+    mutable std::once_flag m_span_finder_once;
+    mutable std::unique_ptr<const SpanFinder> m_span_finder;
+    mutable std::unique_ptr<const Program> m_longest_program;
+};
+
+static const std::size_t DefaultCacheCapacity = 1024;
+
+static PatternCache<RegexImpl> &patternCache()
+{
+    static PatternCache<RegexImpl> cache(DefaultCacheCapacity);
+    return cache;
+}
+
+static std::shared_ptr<const RegexImpl> compile(
+    const std::string &pattern,
+    unsigned flags)
+{
+    auto make = [&pattern, flags]() {
+        return std::make_shared<const RegexImpl>(pattern, flags);
+    };
+
+    if (flags & Regex::NoCache)
+    {
+        return make();
+    }
+
+    return patternCache().get(pattern, flags, make);
+}
+
+Regex::Scratch::Scratch()
+    : m_impl{new ScratchImpl}
+{
+}
+
+Regex::Scratch::~Scratch() = default;
+
+Regex::Scratch::Scratch(Scratch &&other) = default;
+
+Regex::Scratch &Regex::Scratch::operator=(Scratch &&other) = default;
+
+Regex::Regex(const std::string &pattern, unsigned flags)
+    : m_impl{compile(pattern, flags)}
+{
+}
+
+Regex::Regex(std::shared_ptr<const RegexImpl> impl)
+    : m_impl{std::move(impl)}
+{
+}
+
+std::vector<Regex> Regex::compileAll(
+    const std::vector<std::string> &patterns,
+    unsigned flags,
+    std::size_t threads)
+{
+    if (threads == 0)
+    {
+        threads = std::thread::hardware_concurrency();
+    }
+
+    threads = std::max<std::size_t>(std::min(threads, patterns.size()), 1);
+
+    std::vector<std::shared_ptr<const RegexImpl>> impls(patterns.size());
+    std::vector<std::exception_ptr> errors(patterns.size());
+    std::atomic<std::size_t> next{0};
+
+    auto work = [&]() {
+        for (std::size_t i = next++; i < patterns.size(); i = next++)
+        {
+            try
+            {
+                impls[i] = compile(patterns[i], flags);
+            }
+            catch (...)
+            {
+                errors[i] = std::current_exception();
+            }
+        }
+    };
+
+    std::vector<std::thread> workers;
+
+    for (std::size_t i = 1; i < threads; i++)
+    {
+        workers.emplace_back(work);
+    }
+
+    work();
+
+    for (std::thread &worker : workers)
+    {
+        worker.join();
+    }
+
+    for (const std::exception_ptr &error : errors)
+    {
+        if (error)
+        {
+            std::rethrow_exception(error);
+        }
+    }
+
+    std::vector<Regex> regexes;
+
+    for (auto &impl : impls)
+    {
+        regexes.push_back(Regex(std::move(impl)));
+    }
+
+    return regexes;
+}
+
+bool Regex::match(const std::string &str) const
+{
+    static thread_local Scratch scratch;
+    return match(str, scratch);
+}
+
+bool Regex::match(const std::string &str, Scratch &scratch) const
+{
+    return m_impl->match(str, RegexImpl::getScratch(scratch));
+}
+
+bool Regex::match(
+    const std::string &str,
+    std::vector<Submatch> &submatches) const
+{
+    static thread_local Scratch scratch;
+    return match(str, submatches, scratch);
+}
+
+bool Regex::match(
+    const std::string &str,
+    std::vector<Submatch> &submatches,
+    Scratch &scratch) const
+{
+    return m_impl->match(str, submatches, RegexImpl::getScratch(scratch));
+}
+
+bool Regex::search(const std::string &str) const
+{
+    static thread_local Scratch scratch;
+    return m_impl->search(str, RegexImpl::getScratch(scratch));
+}
+
+bool Regex::find(const std::string &str, Submatch &match, std::size_t pos)
+    const
+{
+    static thread_local Scratch scratch;
+    SpanFinder::span_t span;
+
+    if (!m_impl->find(str, pos, span, RegexImpl::getScratch(scratch)))
+    {
+        return false;
+    }
+
+    match = Submatch{span.first, span.second};
+    return true;
+}
+
+std::vector<Regex::Submatch> Regex::findAll(const std::string &str) const
+{
+    static thread_local Scratch scratch;
+    std::vector<SpanFinder::span_t> spans;
+    m_impl->findAll(str, spans, RegexImpl::getScratch(scratch));
+
+    std::vector<Submatch> matches;
+
+    for (const auto &span : spans)
+    {
+        matches.push_back(Submatch{span.first, span.second});
+    }
+
+    return matches;
+}
+
+std::size_t Regex::getCaptureCount() const
+{
+    return m_impl->getCaptureCount();
+}
+
+bool Regex::isCompiled() const
+{
+    return m_impl->isCompiled();
+}
+
+void Regex::matchBatch(
+    const std::vector<std::string_view> &strs,
+    std::vector<bool> &out) const
+{
+    m_impl->matchBatch(strs, out);
+}
+
+Fsm Regex::buildFsm(
+    const std::string &pattern,
+    std::pmr::memory_resource *resource)
+{
+    return RegexParser().parse(pattern)->compile(resource);
+}
+
+void Regex::setCacheCapacity(std::size_t capacity)
 {
+    patternCache().setCapacity(capacity);
 }
 
-bool Regex::match(const std::string &str)
+void Regex::clearCache()
 {
-    return m_impl->match(str);
+    patternCache().clear();
 }
 
-Fsm Regex::buildFsm(const std::string &pattern)
+std::size_t Regex::getCacheSize()
 {
-    return RegexParser().parse(pattern)->compile();
+    return patternCache().size();
 }
 
 #undef FOREACH_TEMPLATE_PACK
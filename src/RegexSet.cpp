@@ -0,0 +1,252 @@
+#include "fsm/RegexSet.hpp"
+#include <limits>
+#include <memory_resource>
+#include "fsm/ByteClasses.hpp"
+#include "fsm/Dfa.hpp"
+#include "fsm/Fsm.hpp"
+#include "fsm/Regex.hpp"
+
+namespace fsm {
+
+static const std::uint32_t UnknownState =
+    std::numeric_limits<std::uint32_t>::max();
+
+RegexSet::RegexSet()
+    : m_next_id{0}
+    , m_version{0}
+    , m_product_size{0}
+    , m_product(new ProductState[MaxProductStates])
+{
+    rebuild();
+}
+
+RegexSet::~RegexSet() = default;
+
+RegexSet::id_t RegexSet::add(const std::string &pattern)
+{
+    std::pmr::monotonic_buffer_resource arena;
+    std::shared_ptr<const Dfa> dfa = std::make_shared<const Dfa>(
+        Regex::buildFsm(pattern, &arena).simplify().min());
+
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+
+    id_t id = m_next_id++;
+    m_patterns.emplace(id, dfa);
+
+    rebuild();
+
+    return id;
+}
+
+void RegexSet::remove(id_t id)
+{
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+
+    if (m_patterns.erase(id) == 0)
+    {
+        return;
+    }
+
+    rebuild();
+}
+
+std::vector<RegexSet::id_t> RegexSet::match(const std::string &str) const
+{
+    std::shared_lock<std::shared_mutex> shared(m_mutex);
+
+    std::uint32_t state = 0;
+    std::size_t i = 0;
+
+    for (; i < str.size() && !m_product[state].decided; i++)
+    {
+        unsigned char byte = static_cast<unsigned char>(str[i]);
+        std::uint32_t next =
+            m_product_table[state * m_class_count + m_classes[byte]].load(
+                std::memory_order_acquire);
+
+        if (next == UnknownState)
+        {
+            next = addTransition(state, byte);
+
+            if (next == UnknownState)
+            {
+                break;
+            }
+        }
+
+        state = next;
+    }
+
+    if (i == str.size() || m_product[state].decided)
+    {
+        return m_product[state].matches;
+    }
+
+    // The product is full. Other matches may be walking it, so it is only
+    // flushed under the exclusive lock, kept for the rest of the input.
+    std::vector<state_t> states = m_product[state].states;
+    std::size_t version = m_version;
+
+    shared.unlock();
+    std::unique_lock<std::shared_mutex> exclusive(m_mutex);
+
+    if (m_version != version)
+    {
+        // The set changed in between, so the match starts over with it
+        resetProduct();
+        state = 0;
+        i = 0;
+    }
+    else
+    {
+        if (m_product_size >= MaxProductStates)
+        {
+            resetProduct();
+        }
+
+        state = getProductState(states);
+    }
+
+    for (; i < str.size() && !m_product[state].decided; i++)
+    {
+        unsigned char byte = static_cast<unsigned char>(str[i]);
+        std::uint32_t next = addTransition(state, byte);
+
+        if (next == UnknownState)
+        {
+            states = m_product[state].states;
+            resetProduct();
+            state = getProductState(states);
+            next = addTransition(state, byte);
+        }
+
+        state = next;
+    }
+
+    return m_product[state].matches;
+}
+
+std::size_t RegexSet::size() const
+{
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+    return m_patterns.size();
+}
+
+void RegexSet::rebuild()
+{
+    m_version++;
+
+    m_dfas.clear();
+    m_ids.clear();
+    m_classes.fill(0);
+    m_class_count = 1;
+
+    for (const auto &pair : m_patterns)
+    {
+        m_dfas.push_back(pair.second.get());
+        m_ids.push_back(pair.first);
+        m_class_count =
+            ByteClasses::refine(m_classes, pair.second->getClasses());
+    }
+
+    m_product_table.reset(
+        new std::atomic<std::uint32_t>[MaxProductStates * m_class_count]);
+
+    resetProduct();
+}
+
+std::uint32_t RegexSet::getProductState(
+    const std::vector<state_t> &states) const
+{
+    auto it = m_product_ids.find(states);
+
+    if (it != m_product_ids.end())
+    {
+        return it->second;
+    }
+
+    if (m_product_size >= MaxProductStates)
+    {
+        return UnknownState;
+    }
+
+    std::uint32_t id = static_cast<std::uint32_t>(m_product_size);
+    ProductState &product = m_product[id];
+
+    product.states = states;
+    product.matches.clear();
+    product.decided = true;
+
+    for (std::size_t i = 0; i < m_dfas.size(); i++)
+    {
+        if (m_dfas[i]->isFinal(states[i]))
+        {
+            product.matches.push_back(m_ids[i]);
+        }
+
+        product.decided = product.decided &&
+                          (m_dfas[i]->isDead(states[i]) ||
+                           m_dfas[i]->isAbsorbing(states[i]));
+    }
+
+    for (std::size_t c = 0; c < m_class_count; c++)
+    {
+        m_product_table[id * m_class_count + c].store(
+            UnknownState, std::memory_order_relaxed);
+    }
+
+    m_product_ids.emplace(states, id);
+    m_product_size++;
+
+    return id;
+}
+
+std::uint32_t RegexSet::addTransition(
+    std::uint32_t state,
+    unsigned char byte) const
+{
+    std::lock_guard<std::mutex> lock(m_product_mutex);
+
+    std::atomic<std::uint32_t> &entry =
+        m_product_table[state * m_class_count + m_classes[byte]];
+    std::uint32_t next = entry.load(std::memory_order_relaxed);
+
+    // Another match may have added it since it was looked up
+    if (next != UnknownState)
+    {
+        return next;
+    }
+
+    std::vector<state_t> states = m_product[state].states;
+
+    for (std::size_t i = 0; i < m_dfas.size(); i++)
+    {
+        states[i] = m_dfas[i]->next(states[i], byte);
+    }
+
+    next = getProductState(states);
+
+    if (next != UnknownState)
+    {
+        entry.store(next, std::memory_order_release);
+    }
+
+    return next;
+}
+
+void RegexSet::resetProduct() const
+{
+    m_product_ids.clear();
+    m_product_size = 0;
+
+    std::vector<state_t> states;
+
+    for (const Dfa *dfa : m_dfas)
+    {
+        states.push_back(dfa->getStartingState());
+    }
+
+    getProductState(states);
+}
+
+} // namespace fsm
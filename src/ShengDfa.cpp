@@ -0,0 +1,171 @@
+#include "fsm/ShengDfa.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include "fsm/Dfa.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define FSM_SHENG_SSSE3
+#include <immintrin.h>
+#endif
+
+namespace fsm {
+
+#ifdef FSM_SHENG_SSSE3
+
+__attribute__((target("ssse3"))) static std::uint8_t runSsse3(
+    const std::array<std::uint8_t, ShengDfa::MaxStates> *masks,
+    std::uint8_t start,
+    const unsigned char *data,
+    std::size_t size)
+{
+    __m128i state = _mm_set1_epi8(static_cast<char>(start));
+
+    for (std::size_t i = 0; i < size; i++)
+    {
+        const __m128i mask = _mm_loadu_si128(
+            reinterpret_cast<const __m128i *>(masks[data[i]].data()));
+        state = _mm_shuffle_epi8(mask, state);
+    }
+
+    return static_cast<std::uint8_t>(_mm_cvtsi128_si32(state));
+}
+
+#endif
+
+ShengDfa::ShengDfa(const Dfa &dfa)
+    : m_start(static_cast<std::uint8_t>(dfa.getIndex(dfa.getStartingState())))
+    , m_final{0}
+    , m_decided{0}
+    , m_simd{false}
+{
+    if (!fits(dfa))
+    {
+        throw std::runtime_error("DFA has too many states");
+    }
+
+    // Lanes past the last state lead to state 0, the dead state
+    for (auto &mask : m_masks)
+    {
+        mask.fill(0);
+    }
+
+    for (std::size_t s = 0; s < dfa.getStateCount(); s++)
+    {
+        Dfa::state_t state = dfa.getState(s);
+
+        for (std::size_t byte = 0; byte < 256; byte++)
+        {
+            m_masks[byte][s] = static_cast<std::uint8_t>(dfa.getIndex(
+                dfa.next(state, static_cast<unsigned char>(byte))));
+        }
+
+        if (dfa.isFinal(state))
+        {
+            m_final |= 1u << s;
+        }
+
+        if (dfa.isDead(state) || dfa.isAbsorbing(state))
+        {
+            m_decided |= 1u << s;
+        }
+    }
+
+#ifdef FSM_SHENG_SSSE3
+    m_simd = __builtin_cpu_supports("ssse3");
+#endif
+}
+
+bool ShengDfa::fits(const Dfa &dfa)
+{
+    return dfa.getStateCount() <= MaxStates;
+}
+
+bool ShengDfa::match(const char *data, std::size_t size) const
+{
+    const unsigned char *bytes = reinterpret_cast<const unsigned char *>(data);
+
+    std::uint8_t state = m_start;
+
+    for (std::size_t i = 0; i < size && !((m_decided >> state) & 1);
+         i += BlockSize)
+    {
+        std::size_t end = std::min(size, i + BlockSize);
+
+#ifdef FSM_SHENG_SSSE3
+        if (m_simd)
+        {
+            state = runSsse3(m_masks.data(), state, bytes + i, end - i);
+            continue;
+        }
+#endif
+
+        for (std::size_t k = i; k < end; k++)
+        {
+            state = m_masks[bytes[k]][state];
+        }
+    }
+
+    return (m_final >> state) & 1;
+}
+
+void ShengDfa::matchBatch(
+    const std::vector<std::string_view> &strs,
+    std::vector<bool> &out) const
+{
+    static const std::size_t Lanes = 4;
+
+    out.assign(strs.size(), false);
+
+    auto step = [this](std::uint8_t state, char c) {
+        return m_masks[static_cast<unsigned char>(c)][state];
+    };
+
+    std::size_t i = 0;
+
+    for (; i + Lanes <= strs.size(); i += Lanes)
+    {
+        const char *p0 = strs[i + 0].data();
+        const char *p1 = strs[i + 1].data();
+        const char *p2 = strs[i + 2].data();
+        const char *p3 = strs[i + 3].data();
+
+        std::size_t common = std::min(
+            std::min(strs[i + 0].size(), strs[i + 1].size()),
+            std::min(strs[i + 2].size(), strs[i + 3].size()));
+
+        std::uint8_t s0 = m_start;
+        std::uint8_t s1 = m_start;
+        std::uint8_t s2 = m_start;
+        std::uint8_t s3 = m_start;
+
+        for (std::size_t k = 0; k < common; k++)
+        {
+            s0 = step(s0, p0[k]);
+            s1 = step(s1, p1[k]);
+            s2 = step(s2, p2[k]);
+            s3 = step(s3, p3[k]);
+        }
+
+        std::uint8_t states[Lanes] = {s0, s1, s2, s3};
+
+        for (std::size_t lane = 0; lane < Lanes; lane++)
+        {
+            const std::string_view &str = strs[i + lane];
+            std::uint8_t state = states[lane];
+
+            for (std::size_t k = common; k < str.size(); k++)
+            {
+                state = step(state, str[k]);
+            }
+
+            out[i + lane] = (m_final >> state) & 1;
+        }
+    }
+
+    for (; i < strs.size(); i++)
+    {
+        out[i] = match(strs[i].data(), strs[i].size());
+    }
+}
+
+} // namespace fsm
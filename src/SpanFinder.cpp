@@ -0,0 +1,100 @@
+#include "fsm/SpanFinder.hpp"
+#include "fsm/Fsm.hpp"
+
+namespace fsm {
+
+std::unique_ptr<const SpanFinder> SpanFinder::build(
+    const Fsm &fsm,
+    const ByteFold &fold,
+    std::size_t max_states)
+{
+    std::unique_ptr<Fsm> forward = fsm.min(max_states);
+    std::unique_ptr<Fsm> reverse = forward ? fsm.rev().min(max_states)
+                                           : nullptr;
+
+    if (!reverse)
+    {
+        return nullptr;
+    }
+
+    std::unique_ptr<const Dfa> leftmost =
+        Dfa(*forward, fold).leftmostLongest(max_states);
+
+    if (!leftmost)
+    {
+        return nullptr;
+    }
+
+    return std::unique_ptr<const SpanFinder>(
+        new SpanFinder(std::move(leftmost), Dfa(*reverse, fold)));
+}
+
+SpanFinder::SpanFinder(std::unique_ptr<const Dfa> forward, Dfa reverse)
+    : m_forward{std::move(forward)}
+    , m_reverse{std::move(reverse)}
+{
+}
+
+bool SpanFinder::find(
+    const char *data,
+    std::size_t size,
+    std::size_t pos,
+    span_t &span) const
+{
+    if (pos > size)
+    {
+        return false;
+    }
+
+    std::size_t length = m_forward->matchLongest(data + pos, size - pos);
+
+    if (length == Dfa::npos)
+    {
+        return false;
+    }
+
+    // The match is the longest suffix of the text up to its end that the
+    // pattern accepts, no earlier start having any match
+    std::size_t end = pos + length;
+    std::size_t begin = end;
+    Dfa::state_t state = m_reverse.getStartingState();
+
+    for (std::size_t i = end; i-- > pos;)
+    {
+        state = m_reverse.next(state, static_cast<unsigned char>(data[i]));
+
+        if (m_reverse.isDead(state))
+        {
+            break;
+        }
+
+        if (m_reverse.isFinal(state))
+        {
+            begin = i;
+        }
+    }
+
+    span = span_t(begin, end);
+
+    return true;
+}
+
+void SpanFinder::findAll(
+    const char *data,
+    std::size_t size,
+    std::vector<span_t> &spans) const
+{
+    spans.clear();
+
+    span_t span;
+
+    for (std::size_t pos = 0; find(data, size, pos, span);)
+    {
+        spans.push_back(span);
+
+        // An empty match is not repeated at the same position
+        pos = span.second > span.first ? span.second : span.second + 1;
+    }
+}
+
+} // namespace fsm
@@ -0,0 +1,1243 @@
+#include <atomic>
+#include <bitset>
+#include <cctype>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+#include <random>
+#include <regex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "fsm/ApproximateMatcher.hpp"
+#include "fsm/CountingResource.hpp"
+#include "fsm/Fsm.hpp"
+#include "fsm/Lexer.hpp"
+#include "fsm/Regex.hpp"
+#include "fsm/RegexSet.hpp"
+#include "PatternCache.hpp"
+
+// Compares fsm::Regex with std::regex (ECMAScript) on random patterns of the
+// syntax RegexParser supports, including the capture groups of matches, then
+// reports compile and match throughput of both.
+// Usage: fsm_differential [iterations] [seed]
+
+class PatternGenerator final
+{
+public:
+    explicit PatternGenerator(unsigned seed)
+        : m_random{seed}
+    {
+    }
+
+    /// Returns a non-empty pattern of at most MaxPatternSize characters
+    std::string pattern()
+    {
+        std::string result;
+        while (result.empty() || result.size() > MaxPatternSize)
+        {
+            result = concatenation(2).text;
+        }
+        return result;
+    }
+
+    /// Returns at most max_size characters, mostly from the alphabet but one
+    /// in eight a line terminator, digit, punctuation or byte above 0x7f
+    std::string input(
+        std::size_t max_size,
+        const std::string &alphabet = "abcd")
+    {
+        static const std::string noise = "\n\r09 ./-\x80\xe9\xff";
+
+        std::string result(m_random() % (max_size + 1), ' ');
+        for (char &c : result)
+        {
+            c = m_random() % 8 ? alphabet[m_random() % alphabet.size()]
+                               : noise[m_random() % noise.size()];
+        }
+        return result;
+    }
+
+private:
+    static const std::size_t MaxPatternSize = 40;
+
+    struct Expression
+    {
+        std::string text;
+        bool nullable;
+    };
+
+    Expression concatenation(int depth)
+    {
+        Expression result{"", true};
+        std::size_t count = 1 + m_random() % 3;
+        for (std::size_t i = 0; i < count; i++)
+        {
+            Expression e = suffix(depth);
+            result.text += e.text;
+            result.nullable = result.nullable && e.nullable;
+        }
+        return result;
+    }
+
+    Expression suffix(int depth)
+    {
+        Expression e = term(depth);
+
+        // Quantifying nullable expressions makes the backtracking std::regex
+        // exponential, so they are left alone
+        if (e.nullable)
+        {
+            return e;
+        }
+
+        switch (m_random() % 6)
+        {
+        case 0:
+            return {e.text + "*", true};
+        case 1:
+            return {e.text + "+", false};
+        case 2:
+            return {e.text + "?", true};
+        default:
+            return e;
+        }
+    }
+
+    Expression term(int depth)
+    {
+        switch (depth > 0 ? m_random() % 8 : m_random() % 4)
+        {
+        case 0:
+        case 1:
+            return {std::string(1, "abc"[m_random() % 3]), false};
+        case 2:
+        {
+            static const char *const classes[] = {"[a-b]", "[ac-d]", "[0-9]"};
+            return {classes[m_random() % 3], false};
+        }
+        case 3:
+            return {".", false};
+        case 4:
+        {
+            Expression e = concatenation(depth - 1);
+            return {(m_random() % 2 ? "(" : "(?:") + e.text + ")", e.nullable};
+        }
+        case 5:
+            return {m_random() % 2 ? "()" : "(?:)", true};
+        default:
+        {
+            Expression result{"(", false};
+            std::size_t count = 2 + m_random() % 2;
+            for (std::size_t i = 0; i < count; i++)
+            {
+                Expression e = concatenation(depth - 1);
+                result.text += (i > 0 ? "|" : "") + e.text;
+                result.nullable = result.nullable || e.nullable;
+            }
+            result.text += ")";
+            return result;
+        }
+        }
+    }
+
+private:
+    std::mt19937 m_random;
+};
+
+static bool checkPattern(PatternGenerator &generator, const std::string &pattern)
+{
+    fsm::Regex regex(pattern, fsm::Regex::NoCache);
+    std::regex std_regex(pattern, std::regex::ECMAScript);
+
+    for (int i = 0; i < 50; i++)
+    {
+        std::string input = generator.input(10);
+
+        bool match = regex.match(input);
+        bool std_match = std::regex_match(input, std_regex);
+
+        std::smatch std_search;
+        bool search = regex.search(input);
+        bool std_found = std::regex_search(input, std_search, std_regex);
+
+        // Both pick the leftmost start, but std::regex prefers the first
+        // alternative over the longest match, so only starts are compared
+        fsm::Regex::Submatch found;
+        bool find = regex.find(input, found);
+
+        if (match != std_match || search != std_found || find != std_found ||
+            (find &&
+             found.begin != static_cast<std::size_t>(std_search.position())))
+        {
+            std::cerr << "mismatch: pattern \"" << pattern << "\", input \""
+                      << input << "\": match " << match << "/" << std_match
+                      << ", search " << search << "/" << std_found << ", find "
+                      << find << "/" << std_found << std::endl;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool checkSubmatches(
+    PatternGenerator &generator,
+    const std::string &pattern)
+{
+    fsm::Regex regex(pattern, fsm::Regex::NoCache);
+    std::regex std_regex(pattern, std::regex::ECMAScript);
+
+    std::vector<fsm::Regex::Submatch> submatches;
+
+    for (int i = 0; i < 50; i++)
+    {
+        std::string input = generator.input(10);
+
+        std::smatch std_submatches;
+        bool match = regex.match(input, submatches);
+        bool std_match = std::regex_match(input, std_submatches, std_regex);
+
+        bool agree = match == std_match;
+
+        for (std::size_t k = 0; agree && match && k < std_submatches.size();
+             k++)
+        {
+            std::size_t begin = fsm::Regex::npos;
+            std::size_t end = fsm::Regex::npos;
+
+            if (std_submatches[k].matched)
+            {
+                begin = std_submatches.position(k);
+                end = begin + std_submatches.length(k);
+            }
+
+            agree = k < submatches.size() && submatches[k].begin == begin &&
+                    submatches[k].end == end;
+        }
+
+        if (!agree)
+        {
+            std::cerr << "submatch mismatch: pattern \"" << pattern
+                      << "\", input \"" << input << "\"" << std::endl;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/// Compares find() and findAll() with the leftmost-longest matches found by
+/// trying every substring, longest first, with match()
+static bool checkSpans(PatternGenerator &generator, const std::string &pattern)
+{
+    fsm::Regex regex(pattern, fsm::Regex::NoCache);
+
+    for (int i = 0; i < 20; i++)
+    {
+        std::string input = generator.input(10);
+        std::vector<fsm::Regex::Submatch> expected;
+
+        for (std::size_t pos = 0; pos <= input.size();)
+        {
+            bool found = false;
+
+            for (std::size_t begin = pos; begin <= input.size() && !found;
+                 begin++)
+            {
+                for (std::size_t end = input.size() + 1; end-- > begin;)
+                {
+                    if (regex.match(input.substr(begin, end - begin)))
+                    {
+                        expected.push_back({begin, end});
+                        found = true;
+                        break;
+                    }
+                }
+            }
+
+            if (!found)
+            {
+                break;
+            }
+
+            // An empty match is not repeated at the same position
+            const fsm::Regex::Submatch &last = expected.back();
+            pos = last.end > last.begin ? last.end : last.end + 1;
+        }
+
+        std::vector<fsm::Regex::Submatch> all = regex.findAll(input);
+        fsm::Regex::Submatch first{};
+        bool find = regex.find(input, first);
+
+        bool agree = all.size() == expected.size() &&
+                     find == !expected.empty() &&
+                     (!find || (first.begin == expected[0].begin &&
+                                first.end == expected[0].end));
+
+        for (std::size_t k = 0; agree && k < all.size(); k++)
+        {
+            agree = all[k].begin == expected[k].begin &&
+                    all[k].end == expected[k].end;
+        }
+
+        if (!agree)
+        {
+            std::cerr << "span mismatch: pattern \"" << pattern
+                      << "\", input \"" << input << "\"" << std::endl;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/// Compares matchBatch with match on batches of every size up to 9, whose
+/// strings have mixed lengths and are empty now and then
+static bool checkMatchBatch(
+    PatternGenerator &generator,
+    const std::string &pattern)
+{
+    fsm::Regex regex(pattern, fsm::Regex::NoCache);
+
+    std::vector<bool> out;
+
+    for (std::size_t count = 0; count < 10; count++)
+    {
+        std::vector<std::string> inputs;
+        for (std::size_t i = 0; i < count; i++)
+        {
+            inputs.push_back(generator.input(i % 3 ? 12 : 0));
+        }
+
+        std::vector<std::string_view> views(inputs.begin(), inputs.end());
+        regex.matchBatch(views, out);
+
+        for (std::size_t i = 0; i < count; i++)
+        {
+            if (out.size() != count || out[i] != regex.match(inputs[i]))
+            {
+                std::cerr << "batch mismatch: pattern \"" << pattern
+                          << "\", input \"" << inputs[i] << "\", batch of "
+                          << count << std::endl;
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+/// Compares a Deferred regex with an eagerly compiled one, first while its
+/// DFA is likely being built and then once it is
+static bool checkDeferred(
+    PatternGenerator &generator,
+    const std::string &pattern)
+{
+    fsm::Regex regex(pattern, fsm::Regex::NoCache);
+    fsm::Regex deferred(pattern, fsm::Regex::NoCache | fsm::Regex::Deferred);
+
+    auto same = [](const fsm::Regex::Submatch &a,
+                   const fsm::Regex::Submatch &b) {
+        return a.begin == b.begin && a.end == b.end;
+    };
+
+    std::vector<fsm::Regex::Submatch> submatches;
+    std::vector<fsm::Regex::Submatch> deferred_submatches;
+
+    for (int round = 0; round < 2; round++)
+    {
+        if (round == 1)
+        {
+            while (!deferred.isCompiled())
+            {
+                std::this_thread::yield();
+            }
+        }
+
+        for (int i = 0; i < 10; i++)
+        {
+            std::string input = generator.input(10);
+
+            fsm::Regex::Submatch found{};
+            fsm::Regex::Submatch deferred_found{};
+            bool find = regex.find(input, found, 1);
+
+            std::vector<fsm::Regex::Submatch> all = regex.findAll(input);
+            std::vector<fsm::Regex::Submatch> deferred_all =
+                deferred.findAll(input);
+
+            bool agree =
+                regex.match(input) == deferred.match(input) &&
+                regex.search(input) == deferred.search(input) &&
+                find == deferred.find(input, deferred_found, 1) &&
+                (!find || same(found, deferred_found)) &&
+                std::equal(
+                    all.begin(), all.end(), deferred_all.begin(),
+                    deferred_all.end(), same) &&
+                regex.match(input, submatches) ==
+                    deferred.match(input, deferred_submatches) &&
+                std::equal(
+                    submatches.begin(), submatches.end(),
+                    deferred_submatches.begin(), deferred_submatches.end(),
+                    same);
+
+            if (!agree)
+            {
+                std::cerr << "deferred mismatch: pattern \"" << pattern
+                          << "\", input \"" << input << "\", "
+                          << (round == 0 ? "before" : "after")
+                          << " compilation" << std::endl;
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+/// Compares the regexes of compileAll with ones compiled one by one, then
+/// checks that an invalid pattern is rethrown and that duplicate patterns
+/// share a cache entry
+static bool checkCompileAll(PatternGenerator &generator)
+{
+    std::vector<std::string> patterns;
+    for (int i = 0; i < 20; i++)
+    {
+        patterns.push_back(generator.pattern());
+    }
+
+    // Some duplicates, compiled by different threads at the same time
+    for (int i = 0; i < 10; i++)
+    {
+        patterns.push_back(patterns[i]);
+    }
+
+    for (unsigned flags : {fsm::Regex::NoFlags, fsm::Regex::Deferred})
+    {
+        std::vector<fsm::Regex> regexes =
+            fsm::Regex::compileAll(patterns, flags, 4);
+
+        for (std::size_t i = 0; i < patterns.size(); i++)
+        {
+            fsm::Regex regex(patterns[i], fsm::Regex::NoCache);
+
+            for (int k = 0; k < 10; k++)
+            {
+                std::string input = generator.input(10);
+
+                if (regexes.size() != patterns.size() ||
+                    regexes[i].match(input) != regex.match(input) ||
+                    regexes[i].search(input) != regex.search(input))
+                {
+                    std::cerr << "compileAll mismatch: pattern \""
+                              << patterns[i] << "\", input \"" << input
+                              << "\"" << std::endl;
+                    return false;
+                }
+            }
+        }
+    }
+
+    try
+    {
+        fsm::Regex::compileAll({"ab", "(ab", "cd"}, fsm::Regex::NoFlags, 2);
+        std::cerr << "compileAll accepted an invalid pattern" << std::endl;
+        return false;
+    }
+    catch (const std::runtime_error &)
+    {
+    }
+
+    fsm::Regex::clearCache();
+    fsm::Regex::compileAll(
+        {"(ab|cd)*", "[0-9]+", "(ab|cd)*", "(ab|cd)*", "[0-9]+"},
+        fsm::Regex::NoFlags,
+        4);
+
+    if (fsm::Regex::getCacheSize() != 2)
+    {
+        std::cerr << "compileAll cached " << fsm::Regex::getCacheSize()
+                  << " entries for 2 distinct patterns" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+/// Checks PatternCache from several threads: a slow pattern requested by
+/// all of them at once is made once, values always belong to their key and
+/// the shards stay within the capacity. Then checks that a shard evicts its
+/// least recently used entry first.
+static bool checkPatternCache()
+{
+    using Cache = fsm::PatternCache<std::string>;
+    using value_t = Cache::value_t;
+
+    static const std::size_t Threads = 4;
+    static const std::size_t Shards = 4;
+    static const std::size_t Capacity = 16;
+
+    Cache cache(Capacity, Shards);
+    std::atomic<std::size_t> made{0};
+    std::atomic<bool> agree{true};
+
+    auto make = [&made](const std::string &pattern, unsigned flags) {
+        return [&made, pattern, flags]() {
+            made++;
+            return std::make_shared<const std::string>(
+                pattern + "/" + std::to_string(flags));
+        };
+    };
+
+    auto slow = [&made]() {
+        made++;
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        return std::make_shared<const std::string>("slow");
+    };
+
+    std::vector<value_t> slow_values(Threads);
+    std::vector<std::thread> workers;
+
+    for (std::size_t t = 0; t < Threads; t++)
+    {
+        workers.emplace_back(
+            [&, t]() { slow_values[t] = cache.get("slow", 0, slow); });
+    }
+
+    for (std::thread &worker : workers)
+    {
+        worker.join();
+    }
+
+    agree = made == 1;
+
+    for (const value_t &value : slow_values)
+    {
+        agree = agree && value == slow_values[0] && *value == "slow";
+    }
+
+    workers.clear();
+
+    for (std::size_t t = 0; t < Threads; t++)
+    {
+        workers.emplace_back([&, t]() {
+            for (std::size_t i = 0; i < 500; i++)
+            {
+                std::string pattern = "p" + std::to_string((i * 7 + t) % 64);
+                unsigned flags = i % 2;
+
+                value_t value =
+                    cache.get(pattern, flags, make(pattern, flags));
+
+                if (*value != pattern + "/" + std::to_string(flags))
+                {
+                    agree = false;
+                }
+            }
+        });
+    }
+
+    for (std::thread &worker : workers)
+    {
+        worker.join();
+    }
+
+    if (!agree || cache.size() > Capacity)
+    {
+        std::cerr << "pattern cache: wrong value or " << cache.size()
+                  << " entries over a capacity of " << Capacity << std::endl;
+        return false;
+    }
+
+    // With one shard of two entries, touching a keeps it over b
+    Cache lru(2, 1);
+    made = 0;
+
+    value_t a = lru.get("a", 0, make("a", 0));
+    lru.get("b", 0, make("b", 0));
+    lru.get("a", 0, make("a", 0));
+    lru.get("c", 0, make("c", 0));
+
+    bool kept = lru.get("a", 0, make("a", 0)) == a && made == 3;
+    lru.get("b", 0, make("b", 0));
+
+    if (!kept || made != 4 || lru.size() != 2)
+    {
+        std::cerr << "pattern cache: least recently used entry not evicted"
+                  << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+/// Compares IgnoreCase with std::regex::icase on inputs of mixed case,
+/// the pattern being upper case half of the time
+static bool checkIgnoreCase(
+    PatternGenerator &generator,
+    const std::string &pattern,
+    unsigned seed)
+{
+    std::string folded = pattern;
+
+    if (seed % 2)
+    {
+        for (char &c : folded)
+        {
+            c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+        }
+    }
+
+    fsm::Regex regex(folded, fsm::Regex::IgnoreCase | fsm::Regex::NoCache);
+    std::regex std_regex(folded, std::regex::ECMAScript | std::regex::icase);
+
+    for (int i = 0; i < 20; i++)
+    {
+        std::string input = generator.input(10, "abcdABCD");
+
+        if (regex.match(input) != std::regex_match(input, std_regex) ||
+            regex.search(input) != std::regex_search(input, std_regex))
+        {
+            std::cerr << "icase mismatch: pattern \"" << folded
+                      << "\", input \"" << input << "\"" << std::endl;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/// Returns the smallest number of insertions, deletions and substitutions
+/// turning the input, or a substring of it if unanchored, into a string of
+/// the FSM, by dynamic programming over its states
+static std::size_t editDistance(
+    const fsm::Fsm &fsm,
+    const std::string &input,
+    bool anchored)
+{
+    static const std::size_t Infinity = static_cast<std::size_t>(-1) / 2;
+
+    struct Edge
+    {
+        std::size_t from;
+        std::size_t to;
+        bool epsilon;
+        std::bitset<256> bytes;
+    };
+
+    const auto &transitions = fsm.getTransitions();
+    std::size_t states = transitions.size();
+    std::vector<Edge> edges;
+
+    for (std::size_t s1 = 0; s1 < states; s1++)
+    {
+        for (std::size_t s2 = 0; s2 < states; s2++)
+        {
+            Edge edge{s1, s2, false, {}};
+            for (fsm::Fsm::symbol_t a : transitions[s1][s2])
+            {
+                if (a == '\0')
+                {
+                    edge.epsilon = true;
+                }
+                else
+                {
+                    edge.bytes.set(static_cast<unsigned char>(a));
+                }
+            }
+
+            if (edge.epsilon || edge.bytes.any())
+            {
+                edges.push_back(edge);
+            }
+        }
+    }
+
+    // Deleting a byte of the pattern follows an edge without reading it,
+    // and epsilon edges cost nothing, until no distance improves
+    auto close = [&](std::vector<std::size_t> &distances) {
+        for (bool changed = true; changed;)
+        {
+            changed = false;
+            for (const Edge &edge : edges)
+            {
+                std::size_t cost = edge.epsilon ? 0 : 1;
+                if (distances[edge.from] + cost < distances[edge.to])
+                {
+                    distances[edge.to] = distances[edge.from] + cost;
+                    changed = true;
+                }
+            }
+        }
+    };
+
+    auto restart = [&](std::vector<std::size_t> &distances) {
+        for (fsm::Fsm::state_t s : fsm.getStartingStates())
+        {
+            distances[s] = 0;
+        }
+    };
+
+    auto best = [&](const std::vector<std::size_t> &distances) {
+        std::size_t result = Infinity;
+        for (fsm::Fsm::state_t s : fsm.getFinalStates())
+        {
+            result = std::min(result, distances[s]);
+        }
+        return result;
+    };
+
+    std::vector<std::size_t> distances(states, Infinity);
+    restart(distances);
+    close(distances);
+
+    std::size_t result = best(distances);
+
+    for (char c : input)
+    {
+        // Inserting the byte stays put, reading it follows an edge, for
+        // free if the edge reads it
+        std::vector<std::size_t> next(states, Infinity);
+
+        for (std::size_t s = 0; s < states; s++)
+        {
+            next[s] = distances[s] + 1;
+        }
+
+        for (const Edge &edge : edges)
+        {
+            if (edge.bytes.any())
+            {
+                std::size_t cost =
+                    edge.bytes[static_cast<unsigned char>(c)] ? 0 : 1;
+                next[edge.to] =
+                    std::min(next[edge.to], distances[edge.from] + cost);
+            }
+        }
+
+        if (!anchored)
+        {
+            restart(next);
+        }
+
+        close(next);
+        distances.swap(next);
+
+        result = anchored ? best(distances) : std::min(result, best(distances));
+    }
+
+    return result;
+}
+
+/// Compares ApproximateMatcher with the edit distance to the pattern and,
+/// once in a while, to a pattern too long for the bit-parallel rows
+static bool checkApproximate(
+    PatternGenerator &generator,
+    const std::string &pattern,
+    unsigned seed)
+{
+    std::mt19937 random{seed};
+    std::size_t errors = seed % 3;
+
+    std::string tail;
+    for (int i = 0; i < 16; i++)
+    {
+        tail += "abcd";
+    }
+
+    std::vector<std::string> texts{pattern};
+
+    if (seed % 5 == 0)
+    {
+        texts.push_back("(?:" + pattern + ")" + tail);
+    }
+
+    for (const std::string &text : texts)
+    {
+        fsm::Fsm fsm = fsm::Regex::buildFsm(text);
+        fsm::ApproximateMatcher matcher(fsm, errors);
+        fsm::ApproximateMatcher::Cache cache;
+
+        for (int i = 0; i < 10; i++)
+        {
+            std::string input = generator.input(10);
+
+            if (text.size() > pattern.size())
+            {
+                // Close to the tail, so that the errors decide the result
+                input += tail;
+                for (int k = 0; k < 3; k++)
+                {
+                    input[random() % input.size()] = "abcd"[random() % 4];
+                }
+            }
+
+            bool match = editDistance(fsm, input, true) <= errors;
+            bool search = editDistance(fsm, input, false) <= errors;
+
+            if (matcher.match(input.data(), input.size(), cache) != match ||
+                matcher.search(input.data(), input.size(), cache) != search)
+            {
+                std::cerr << "approximate mismatch: pattern \"" << text
+                          << "\", input \"" << input << "\", " << errors
+                          << " errors" << std::endl;
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+/// Checks that a cache is not reused by a matcher built at the address of
+/// one destroyed since, which would reuse its product automaton
+static bool checkApproximateCache()
+{
+    std::string input(70, 'a');
+
+    std::optional<fsm::ApproximateMatcher> matcher;
+    fsm::ApproximateMatcher::Cache cache;
+
+    matcher.emplace(fsm::Regex::buildFsm(std::string(70, 'a')), 1);
+    bool first = matcher->match(input.data(), input.size(), cache);
+
+    matcher.emplace(fsm::Regex::buildFsm(std::string(72, 'a')), 1);
+    bool second = matcher->match(input.data(), input.size(), cache);
+
+    if (!first || second)
+    {
+        std::cerr << "approximate cache reused across matchers" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+/// Compiles and minimizes a pattern through a counting resource over an
+/// arena and checks that no container falls back to the default resource
+static bool checkAllocator(const std::string &pattern)
+{
+    fsm::CountingResource fallback(std::pmr::new_delete_resource());
+    std::pmr::monotonic_buffer_resource arena(std::pmr::new_delete_resource());
+    fsm::CountingResource counting(&arena);
+
+    std::pmr::memory_resource *previous =
+        std::pmr::set_default_resource(&fallback);
+
+    std::size_t states =
+        fsm::Regex::buildFsm(pattern, &counting).simplify().min()
+            .getTransitions().size();
+
+    std::pmr::set_default_resource(previous);
+
+    if (fallback.getAllocationCount() != 0 ||
+        counting.getAllocationCount() == 0 || states == 0)
+    {
+        std::cerr << "allocator not propagated: pattern \"" << pattern
+                  << "\", " << fallback.getAllocationCount()
+                  << " allocations from the default resource" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+/// Checks that the parallel subset construction numbers states exactly as
+/// the sequential one. Random patterns have DFAs small enough for it to
+/// run det() instead, so main() also calls it on a larger one.
+static bool checkDetParallel(const std::string &pattern)
+{
+    fsm::Fsm nfa = fsm::Regex::buildFsm(pattern);
+    fsm::Fsm dfa = nfa.det();
+
+    for (std::size_t threads : {1, 2, 4})
+    {
+        fsm::Fsm parallel = nfa.detParallel(threads);
+
+        if (parallel.getTransitions() != dfa.getTransitions() ||
+            parallel.getStartingStates() != dfa.getStartingStates() ||
+            parallel.getFinalStates() != dfa.getFinalStates())
+        {
+            std::cerr << "detParallel mismatch: pattern \"" << pattern
+                      << "\", " << threads << " threads" << std::endl;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/// Compares RegexSet::match with the patterns of the set matched one by
+/// one, as patterns are added and removed
+static bool checkRegexSet(PatternGenerator &generator, unsigned seed)
+{
+    std::mt19937 random{seed};
+
+    fsm::RegexSet set;
+    std::map<fsm::RegexSet::id_t, fsm::Regex> regexes;
+    std::map<fsm::RegexSet::id_t, std::string> patterns;
+
+    for (int round = 0; round < 4; round++)
+    {
+        if (!regexes.empty() && random() % 3 == 0)
+        {
+            auto it = std::next(regexes.begin(), random() % regexes.size());
+            set.remove(it->first);
+            patterns.erase(it->first);
+            regexes.erase(it);
+        }
+        else
+        {
+            std::string pattern = generator.pattern();
+            fsm::RegexSet::id_t id = set.add(pattern);
+            regexes.emplace(id, fsm::Regex(pattern, fsm::Regex::NoCache));
+            patterns.emplace(id, pattern);
+        }
+
+        for (int i = 0; i < 20; i++)
+        {
+            std::string input = generator.input(10);
+            std::vector<fsm::RegexSet::id_t> expected;
+
+            for (const auto &pair : regexes)
+            {
+                if (pair.second.match(input))
+                {
+                    expected.push_back(pair.first);
+                }
+            }
+
+            if (set.match(input) != expected)
+            {
+                std::cerr << "set mismatch: input \"" << input
+                          << "\", patterns";
+                for (const auto &pair : patterns)
+                {
+                    std::cerr << " \"" << pair.second << "\"";
+                }
+                std::cerr << std::endl;
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+/// Compares Lexer::next with the maximal munch of std::regex over rules
+/// made of random patterns
+static bool checkLexer(PatternGenerator &generator, unsigned seed)
+{
+    std::mt19937 random{seed};
+
+    std::vector<fsm::Lexer::Rule> rules;
+    std::vector<std::regex> std_regexes;
+
+    for (std::size_t i = 0, count = 1 + random() % 4; i < count; i++)
+    {
+        std::string pattern = generator.pattern();
+        rules.push_back({pattern, static_cast<int>(i), int(random() % 2)});
+        std_regexes.emplace_back(pattern, std::regex::ECMAScript);
+    }
+
+    fsm::Lexer lexer(rules);
+
+    for (int i = 0; i < 20; i++)
+    {
+        std::string input = generator.input(10);
+
+        const char *pos = input.data();
+        const char *end = pos + input.size();
+        fsm::Lexer::Token token;
+
+        for (std::size_t begin = 0; begin < input.size();)
+        {
+            // Longest non-empty token, then highest priority, then first rule
+            int id = fsm::Lexer::Error;
+            std::size_t size = 1;
+
+            for (std::size_t n = input.size() - begin; n > 0 && id < 0; n--)
+            {
+                std::string token_text = input.substr(begin, n);
+
+                for (std::size_t r = 0; r < rules.size(); r++)
+                {
+                    if (std::regex_match(token_text, std_regexes[r]) &&
+                        (id < 0 || rules[r].priority > rules[id].priority))
+                    {
+                        id = static_cast<int>(r);
+                        size = n;
+                    }
+                }
+            }
+
+            if (!lexer.next(pos, end, token) || token.id != id ||
+                token.begin != input.data() + begin || token.size != size)
+            {
+                std::cerr << "lexer mismatch: input \"" << input
+                          << "\" at " << begin << ", rules";
+                for (const fsm::Lexer::Rule &rule : rules)
+                {
+                    std::cerr << " \"" << rule.pattern << "\"/"
+                              << rule.priority;
+                }
+                std::cerr << std::endl;
+                return false;
+            }
+
+            begin += size;
+        }
+
+        if (lexer.next(pos, end, token))
+        {
+            std::cerr << "lexer mismatch: token past the end of \"" << input
+                      << "\"" << std::endl;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static double measure(const std::function<void()> &function)
+{
+    auto start = std::chrono::steady_clock::now();
+    function();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(end - start).count();
+}
+
+/// Picks a random string of count characters from the alphabet
+static std::string randomString(
+    std::mt19937 &random,
+    std::size_t count,
+    const std::string &alphabet)
+{
+    std::string result(count, ' ');
+    for (char &c : result)
+    {
+        c = alphabet[random() % alphabet.size()];
+    }
+    return result;
+}
+
+static void benchmark()
+{
+    static const std::string Lower = "abcdefghijklmnopqrstuvwxyz";
+    static const std::string Digits = "0123456789";
+
+    // Each pattern is measured on inputs it was written for, about half of
+    // them matching, rather than on bytes that most patterns reject at once
+    struct Workload
+    {
+        std::string pattern;
+        std::function<std::string(std::mt19937 &)> input;
+    };
+
+    static const std::vector<Workload> workloads = {
+        {"[a-z]+@[a-z]+(\\.[a-z]+)+",
+         [](std::mt19937 &random) {
+             std::string result = randomString(random, 3 + random() % 8, Lower);
+             result += random() % 4 ? "@" : ".";
+             result += randomString(random, 3 + random() % 6, Lower);
+             for (std::size_t i = 0, count = random() % 3; i < count; i++)
+             {
+                 result += "." + randomString(random, 2 + random() % 3, Lower);
+             }
+             return result;
+         }},
+        {"(GET|POST|PUT|DELETE) /[a-z0-9/]*",
+         [](std::mt19937 &random) {
+             static const char *const methods[] = {
+                 "GET", "POST", "PUT", "DELETE", "HEAD", "OPTIONS"};
+             std::string result = methods[random() % 6];
+             result += " /";
+             for (std::size_t i = 0, count = random() % 4; i < count; i++)
+             {
+                 result +=
+                     randomString(random, 1 + random() % 8, Lower + Digits);
+                 result += random() % 8 ? "/" : "?q=1";
+             }
+             return result;
+         }},
+        {"[0-9]+(\\.[0-9]+)?(e[0-9]+)?",
+         [](std::mt19937 &random) {
+             std::string result =
+                 randomString(random, 1 + random() % 8, Digits);
+             if (random() % 2)
+             {
+                 result += random() % 2 ? "." : ",";
+                 result += randomString(random, 1 + random() % 6, Digits);
+             }
+             if (random() % 4 == 0)
+             {
+                 result += "e" + randomString(random, 1 + random() % 2, Digits);
+             }
+             return result;
+         }},
+        {"(ab|cd)*(a|b|c|d)(a|b)(c|d)(a|b)(c|d)",
+         [](std::mt19937 &random) {
+             std::string result;
+             for (std::size_t i = 0, count = random() % 12; i < count; i++)
+             {
+                 result += random() % 2 ? "ab" : "cd";
+             }
+             if (random() % 2)
+             {
+                 return result + randomString(random, 5, "abcd");
+             }
+             result += randomString(random, 1, "abcd");
+             for (int i = 0; i < 4; i++)
+             {
+                 result += randomString(random, 1, i % 2 ? "cd" : "ab");
+             }
+             return result;
+         }},
+    };
+
+    static const int CompileRepeats = 20;
+    static const int MatchRepeats = 20;
+
+    std::cout << std::left << std::setw(42) << "pattern" << std::right
+              << std::setw(14) << "compile/s" << std::setw(14)
+              << "std compile/s" << std::setw(10) << "MB/s" << std::setw(12)
+              << "batch MB/s" << std::setw(10) << "std MB/s" << std::setw(10)
+              << "matched" << std::endl;
+
+    for (const Workload &workload : workloads)
+    {
+        const std::string &pattern = workload.pattern;
+
+        std::mt19937 random{1};
+        std::vector<std::string> inputs;
+        std::size_t bytes = 0;
+        for (int i = 0; i < 2000; i++)
+        {
+            inputs.push_back(workload.input(random));
+            bytes += inputs.back().size();
+        }
+
+        double compile = measure([&]() {
+            for (int i = 0; i < CompileRepeats; i++)
+            {
+                fsm::Regex(pattern, fsm::Regex::NoCache);
+            }
+        });
+
+        double std_compile = measure([&]() {
+            for (int i = 0; i < CompileRepeats; i++)
+            {
+                std::regex(pattern, std::regex::ECMAScript);
+            }
+        });
+
+        fsm::Regex regex(pattern);
+        std::regex std_regex(pattern, std::regex::ECMAScript);
+
+        std::size_t matches = 0;
+        std::size_t std_matches = 0;
+
+        double match = measure([&]() {
+            for (int i = 0; i < MatchRepeats; i++)
+            {
+                for (const std::string &input : inputs)
+                {
+                    matches += regex.match(input);
+                }
+            }
+        });
+
+        std::vector<std::string_view> views(inputs.begin(), inputs.end());
+        std::vector<bool> out;
+
+        double batch = measure([&]() {
+            for (int i = 0; i < MatchRepeats; i++)
+            {
+                regex.matchBatch(views, out);
+            }
+        });
+
+        double std_match = measure([&]() {
+            for (int i = 0; i < MatchRepeats; i++)
+            {
+                for (const std::string &input : inputs)
+                {
+                    std_matches += std::regex_match(input, std_regex);
+                }
+            }
+        });
+
+        double megabytes = static_cast<double>(bytes) * MatchRepeats / 1e6;
+        double matched = 100.0 * matches / (inputs.size() * MatchRepeats);
+
+        std::cout << std::left << std::setw(42) << pattern << std::right
+                  << std::fixed << std::setprecision(0) << std::setw(14)
+                  << CompileRepeats / compile << std::setw(14)
+                  << CompileRepeats / std_compile << std::setprecision(1)
+                  << std::setw(10) << megabytes / match << std::setw(12)
+                  << megabytes / batch << std::setw(10)
+                  << megabytes / std_match << std::setw(9) << matched << "%"
+                  << (matches != std_matches ? "  (results differ)" : "")
+                  << std::endl;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = argc > 1 ? std::atoi(argv[1]) : 100;
+    unsigned seed = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 42;
+
+    PatternGenerator generator(seed);
+
+    int failures = 0;
+    for (int i = 0; i < iterations; i++)
+    {
+        std::string pattern = generator.pattern();
+
+        if (!checkPattern(generator, pattern) ||
+            !checkSubmatches(generator, pattern) ||
+            !checkSpans(generator, pattern) ||
+            !checkMatchBatch(generator, pattern) ||
+            !checkDeferred(generator, pattern) ||
+            !checkIgnoreCase(generator, pattern, seed + i) ||
+            !checkDetParallel(pattern) ||
+            !checkAllocator(pattern) ||
+            !checkApproximate(generator, pattern, seed + i) ||
+            !checkLexer(generator, seed + i) ||
+            !checkRegexSet(generator, seed + i))
+        {
+            failures++;
+        }
+    }
+
+    // 257 states, past the size detParallel builds sequentially
+    std::string wide = "(a|b)*a";
+    for (int i = 0; i < 7; i++)
+    {
+        wide += "(a|b)";
+    }
+
+    if (!checkApproximateCache() || !checkCompileAll(generator) ||
+        !checkPatternCache() || !checkDetParallel(wide))
+    {
+        failures++;
+    }
+
+    std::cout << iterations - failures << "/" << iterations
+              << " patterns agree with std::regex (seed " << seed << ")"
+              << std::endl;
+
+    benchmark();
+
+    return failures == 0 ? 0 : 1;
+}